@@ -0,0 +1,96 @@
+//
+//  alias_table.h
+//  neutralizer_backbone
+//
+//  Walker / Vose alias method: after an O(n) build, every draw from a
+//  discrete distribution costs one table lookup and two random numbers.
+//
+
+#ifndef alias_table_h
+#define alias_table_h
+
+#include <vector>
+#include <cstdint>
+#include "rand_t.h"
+
+class alias_table {
+public:
+  alias_table() {}
+
+  template <typename T>
+  explicit alias_table(const std::vector<T>& weights) {
+    build(weights);
+  }
+
+  template <typename T>
+  void build(const std::vector<T>& weights) {
+    const size_t n = weights.size();
+    table_.assign(n, entry{1.f, 0});
+    if (n == 0) return;
+
+    double total = 0.0;
+    for (const auto& w : weights) total += static_cast<double>(w);
+
+    // scaled probabilities, mean 1.0
+    std::vector<double> scaled(n);
+    std::vector<uint32_t> small, large;
+    small.reserve(n);
+    large.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      scaled[i] = static_cast<double>(weights[i]) * n / total;
+      if (scaled[i] < 1.0) {
+        small.push_back(static_cast<uint32_t>(i));
+      } else {
+        large.push_back(static_cast<uint32_t>(i));
+      }
+    }
+
+    while (!small.empty() && !large.empty()) {
+      auto s = small.back(); small.pop_back();
+      auto l = large.back();
+      table_[s] = entry{static_cast<float>(scaled[s]), l};
+      scaled[l] -= 1.0 - scaled[s];
+      if (scaled[l] < 1.0) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+    // whatever is left is 1.0 up to rounding error
+    for (auto i : large) table_[i] = entry{1.f, i};
+    for (auto i : small) table_[i] = entry{1.f, i};
+  }
+
+  // probability and alias share a cache line, so a draw touches memory once
+  struct entry {
+    float prob;
+    uint32_t alias;
+  };
+
+  // a table built before, e.g. read back from meta_cache
+  void assign(const entry* table, size_t n) {
+    table_.assign(table, table + n);
+  }
+
+  const std::vector<entry>& entries() const noexcept {
+    return table_;
+  }
+
+  size_t sample(rnd_t& rndgen) const {
+    size_t index = rndgen.random_number(table_.size());
+    const auto& e = table_[index];
+    return rndgen.uniform() < e.prob ? index : e.alias;
+  }
+
+  size_t size() const noexcept {
+    return table_.size();
+  }
+
+  bool empty() const noexcept {
+    return table_.empty();
+  }
+
+private:
+  std::vector<entry> table_;
+};
+
+#endif /* alias_table_h */
@@ -0,0 +1,484 @@
+//
+//  batch_main.cpp
+//  neutralizer_batch
+//
+//  Headless driver for the simulation core: no Qt, no plotting, every
+//  event is spent in simulation::update().
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+
+#include "simulation.h"
+#include "tiled_engine.h"
+#include "coalescence.h"
+#include "kmc_engine.h"
+#include "wright_fisher.h"
+#include "replicate_runner.h"
+#include "well_mixed.h"
+
+struct batch_params {
+  size_t L = 100;
+  double spec_rate = 1e-4;
+  double migr_rate = 1e-4;
+  double disp_range = 1;
+  size_t Jm = 10000;
+  double theta = 10;
+  double generations = 100;
+  double interval = 1;
+  bool init_mono_dom = false;
+  bool coalescence = false;
+  bool kmc = false;
+  bool wright_fisher = false;
+  bool spatial = false;
+  std::vector<double> sweep_rates;
+  bool grains = false;
+  bool hll = false;
+  size_t hll_base = 0;          // 0: from the memory budget
+  size_t hll_precision = 10;
+  bool pcf = false;
+  std::string kernel = "polar";
+  metacommunity_mode meta_mode = metacommunity_mode::fixed;
+  double meta_rate = 1.0;
+  bool meta_background = false;
+  size_t seed = static_cast<size_t>(rnd_t::get_seed());
+  size_t num_threads = 1;
+  bool threads_set = false;     // --threads given; replicates default to all cores
+  size_t num_replicates = 1;
+  std::string prefix = "neutralizer";
+  std::string cache_dir;
+  size_t cache_max_mib = 256;
+};
+
+void print_usage(const char* name) {
+  std::cerr << "usage: " << name << " [options]\n"
+            << "  --L <int>            side length of the local community (100)\n"
+            << "  --spec <double>      speciation rate (1e-4)\n"
+            << "  --migr <double>      migration rate (1e-4)\n"
+            << "  --disp <double>      dispersal range (1)\n"
+            << "  --Jm <int>           metacommunity size (10000), 0 for an infinite\n"
+            << "                       metacommunity (lazy mode only)\n"
+            << "  --theta <double>     fundamental biodiversity number (10)\n"
+            << "  --generations <dbl>  number of generations to run (100)\n"
+            << "  --interval <dbl>     generations between outputs (1)\n"
+            << "  --mono               start from a monodominant community\n"
+            << "  --coalescence        start from the equilibrium community, built\n"
+            << "                       backwards in time by coalescence\n"
+            << "  --sweep <list>       with --coalescence: richness and octaves of the\n"
+            << "                       equilibrium for each comma separated speciation\n"
+            << "                       rate (>= --spec), all from the same genealogy\n"
+            << "  --grains             also write richness per block size (1, 2, 4, ...)\n"
+            << "                       and, at the end, occupancy per species\n"
+            << "  --pcf                write the conspecific pair correlation F(r) at the end\n"
+            << "  --hll                with --grains: estimate richness with HyperLogLog\n"
+            << "                       sketches, written as mean and its standard error\n"
+            << "                       per grain (exact)\n"
+            << "  --hll-base <int>     side of the smallest sketched blocks (0: as small\n"
+            << "                       as the memory budget allows, see hll_sketch.h)\n"
+            << "  --hll-precision <n>  2^n registers per sketch, 4 to 18 (10)\n"
+            << "  --meta <mode>        metacommunity: fixed (built at the start), lazy\n"
+            << "                       (species drawn on demand) or dynamic (drifts\n"
+            << "                       along with the local community) (fixed)\n"
+            << "  --meta-rate <dbl>    dynamic metacommunity events per local event (1)\n"
+            << "  --meta-background    run the dynamic metacommunity in its own thread;\n"
+            << "                       faster, but runs are no longer reproducible\n"
+            << "  --kernel <name>      dispersal kernel: polar, gaussian, exponential,\n"
+            << "                       fat_tailed (2Dt, shape 1), cauchy (2Dt, shape\n"
+            << "                       0.5), von_neumann or moore (polar); --disp is\n"
+            << "                       the range of polar, capped at L, and the scale\n"
+            << "                       of the other radial kernels\n"
+            << "  --seed <int>         random seed (taken from the clock)\n"
+            << "  --threads <int>      threads for the tiled parallel engine (1: serial),\n"
+            << "                       or for the replicate pool (0: all cores, the\n"
+            << "                       default with --replicates)\n"
+            << "  --replicates <int>   independent replicates, run in parallel (1)\n"
+            << "  --kmc                skip events that cannot change the world\n"
+            << "                       (serial, short dispersal only)\n"
+            << "  --wright-fisher      replace all cells at once every generation, from\n"
+            << "                       the previous one (parallel with --threads); not\n"
+            << "                       the Moran process, see wright_fisher.h\n"
+            << "  --spatial            keep the grid when dispersal spans the landscape\n"
+            << "                       (--disp >= L), which otherwise runs the well-mixed\n"
+            << "                       model; spatial outputs keep the grid as well\n"
+            << "  --out <prefix>       prefix of the output files (neutralizer)\n"
+            << "  --cache <dir>        keep built metacommunities in dir and reuse them\n"
+            << "                       for the same Jm, theta and seed (off)\n"
+            << "  --cache-max <MiB>    size limit of the cache directory; the least\n"
+            << "                       recently used files are removed (256, 0: none)\n"
+            << "one generation is L * L events.\n";
+}
+
+bool parse_args(int argc, char* argv[], batch_params& p) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--mono") {
+      p.init_mono_dom = true;
+      continue;
+    }
+    if (arg == "--coalescence") {
+      p.coalescence = true;
+      continue;
+    }
+    if (arg == "--kmc") {
+      p.kmc = true;
+      continue;
+    }
+    if (arg == "--wright-fisher") {
+      p.wright_fisher = true;
+      continue;
+    }
+    if (arg == "--meta-background") {
+      p.meta_background = true;
+      continue;
+    }
+    if (arg == "--spatial") {
+      p.spatial = true;
+      continue;
+    }
+    if (arg == "--grains") {
+      p.grains = true;
+      continue;
+    }
+    if (arg == "--hll") {
+      p.hll = true;
+      continue;
+    }
+    if (arg == "--pcf") {
+      p.pcf = true;
+      continue;
+    }
+    if (arg == "--help" || arg == "-h") return false;
+    if (i + 1 >= argc) {
+      std::cerr << "missing value for " << arg << "\n";
+      return false;
+    }
+    std::string val = argv[++i];
+    if (arg == "--L")                p.L = std::stoul(val);
+    else if (arg == "--spec")        p.spec_rate = std::stod(val);
+    else if (arg == "--migr")        p.migr_rate = std::stod(val);
+    else if (arg == "--disp")        p.disp_range = std::stod(val);
+    else if (arg == "--Jm")          p.Jm = std::stoul(val);
+    else if (arg == "--theta")       p.theta = std::stod(val);
+    else if (arg == "--generations") p.generations = std::stod(val);
+    else if (arg == "--interval")    p.interval = std::stod(val);
+    else if (arg == "--kernel")      p.kernel = val;
+    else if (arg == "--meta" && val == "fixed") p.meta_mode = metacommunity_mode::fixed;
+    else if (arg == "--meta" && val == "lazy")  p.meta_mode = metacommunity_mode::lazy;
+    else if (arg == "--meta" && val == "dynamic") p.meta_mode = metacommunity_mode::dynamic;
+    else if (arg == "--meta-rate")   p.meta_rate = std::stod(val);
+    else if (arg == "--seed")        p.seed = std::stoul(val);
+    else if (arg == "--threads") {
+      p.num_threads = std::stoul(val);
+      p.threads_set = true;
+    }
+    else if (arg == "--replicates")  p.num_replicates = std::stoul(val);
+    else if (arg == "--out")         p.prefix = val;
+    else if (arg == "--cache")       p.cache_dir = val;
+    else if (arg == "--cache-max")   p.cache_max_mib = std::stoul(val);
+    else if (arg == "--hll-base")    p.hll_base = std::stoul(val);
+    else if (arg == "--hll-precision") p.hll_precision = std::stoul(val);
+    else if (arg == "--sweep") {
+      std::stringstream list(val);
+      std::string rate;
+      while (std::getline(list, rate, ',')) p.sweep_rates.push_back(std::stod(rate));
+    }
+    else {
+      std::cerr << "unknown option " << arg << " " << val << "\n";
+      return false;
+    }
+  }
+  if (p.L < 1 || p.interval <= 0.0 || p.spec_rate + p.migr_rate <= 0.0 ||
+      (p.Jm == 0 && p.meta_mode != metacommunity_mode::lazy) ||
+      (!p.sweep_rates.empty() && !p.coalescence) ||
+      (p.hll && !p.grains) ||
+      p.hll_precision < 4 || p.hll_precision > 18) {
+    std::cerr << "invalid parameters\n";
+    return false;
+  }
+  // only the polar range is bounded by the landscape; sigma and the
+  // scales of the other radial kernels may exceed L
+  if (p.kernel == "polar" && p.disp_range > p.L) p.disp_range = p.L;
+  return true;
+}
+
+template <typename T>
+void write_row(std::ofstream& out, double time, const std::vector<T>& v) {
+  out << time;
+  for (const auto& i : v) out << "\t" << i;
+  out << "\n";
+}
+
+// replicates are independent streams (seed, replicate) of one parameter set
+template <typename SIM>
+int run_replicates(const batch_params& p, typename replicate_runner<SIM>::factory make_sim) {
+  const size_t cells = p.L * p.L;
+  replicate_settings settings;
+  settings.num_replicates = p.num_replicates;
+  settings.num_threads = p.threads_set ? p.num_threads : 0;
+  settings.events_per_sample = std::max<size_t>(1, static_cast<size_t>(p.interval * cells));
+  settings.num_samples = static_cast<size_t>(p.generations * cells) / settings.events_per_sample;
+  settings.prefix = p.prefix;
+
+  replicate_runner<SIM> runner(make_sim, settings);
+
+  auto start = std::chrono::steady_clock::now();
+  runner.run();
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << "seed " << p.seed << ": ran " << p.num_replicates << " replicates in "
+            << secs << " s\n";
+  return 0;
+}
+
+// every kernel gets its own instantiation of the update loop
+template <typename DISPERSAL>
+int run(const batch_params& p) {
+  if (p.num_replicates > 1) {
+    if (p.wright_fisher) std::cerr << "replicates run the Moran process, ignoring --wright-fisher\n";
+    if (p.kmc) std::cerr << "replicates draw every event, ignoring --kmc\n";
+    if (p.grains) std::cerr << "replicates write no grains, ignoring --grains" << (p.hll ? " and --hll\n" : "\n");
+    if (p.pcf) std::cerr << "replicates write no pair correlation, ignoring --pcf\n";
+    if (!p.sweep_rates.empty()) std::cerr << "replicates write no sweep, ignoring --sweep\n";
+    return run_replicates< simulation_t<DISPERSAL> >(p, [&p](size_t replicate) {
+      auto sim = std::make_unique< simulation_t<DISPERSAL> >(p.L, p.spec_rate, p.migr_rate, p.Jm,
+                                                             p.disp_range, p.theta, p.init_mono_dom,
+                                                             p.seed, replicate, p.meta_mode,
+                                                             p.meta_rate, p.meta_background);
+      if (p.coalescence) coalescence_engine<DISPERSAL>(*sim).run();
+      return sim;
+    });
+  }
+
+  std::ofstream out_richness(p.prefix + "_richness.txt");
+  std::ofstream out_octaves(p.prefix + "_octaves.txt");
+  std::ofstream out_rank_abund(p.prefix + "_rank_abund.txt");
+  std::ofstream out_grains;
+  if (p.grains) out_grains.open(p.prefix + "_grains.txt");
+  if (p.grains && p.hll) {
+    const size_t base = p.hll_base > 0 ? p.hll_base
+                                       : hll_block_aggregation::budget_base_side(p.L, p.hll_precision);
+    std::cerr << "hll: grains " << base << ", " << 2 * base << ", ... with 2^"
+              << p.hll_precision << " registers per sketch\n";
+  }
+  if (!out_richness || !out_octaves || !out_rank_abund || (p.grains && !out_grains)) {
+    std::cerr << "could not open output files with prefix " << p.prefix << "\n";
+    return 1;
+  }
+
+  simulation_t<DISPERSAL> sim(p.L, p.spec_rate, p.migr_rate, p.Jm,
+                              p.disp_range, p.theta, p.init_mono_dom,
+                              p.seed, 0, p.meta_mode, p.meta_rate, p.meta_background);
+  if (p.coalescence) {
+    coalescence_engine<DISPERSAL> coalescence(sim);
+    auto stats = coalescence.run();
+    std::cerr << "coalescence: " << stats.num_roots << " roots after " << stats.steps
+              << " steps in " << stats.seconds << " s\n";
+    if (!p.sweep_rates.empty()) {
+      // one row per rate: rate, richness, then the Preston octaves
+      std::ofstream out_sweep(p.prefix + "_sweep.txt");
+      for (const auto& snap : coalescence.sweep(p.sweep_rates, p.num_threads)) {
+        std::vector<size_t> octaves(1 + simulation_t<DISPERSAL>::octave_of(p.L * p.L), 0);
+        for (auto n : snap.abundance) octaves[simulation_t<DISPERSAL>::octave_of(n)]++;
+        out_sweep << snap.spec_rate << "\t" << snap.abundance.size();
+        for (auto n : octaves) out_sweep << "\t" << n;
+        out_sweep << "\n";
+      }
+    }
+  }
+
+  const double events_per_generation = static_cast<double>(p.L * p.L);
+  const size_t total_events = static_cast<size_t>(p.generations * events_per_generation);
+  const size_t output_step = std::max<size_t>(1, static_cast<size_t>(p.interval * events_per_generation));
+
+  out_richness << "generation\tnum_species\n";
+
+  auto record = [&]() {
+    sim.update_stats();
+    double gen = sim.t / events_per_generation;
+    out_richness << gen << "\t" << sim.num_species() << "\n";
+    write_row(out_octaves, gen, sim.get_local_octaves());
+    write_row(out_rank_abund, gen, sim.rank_abund_curve);
+    if (p.grains && p.hll) {
+      std::vector<double> richness;
+      for (const auto& g : sim.approx_multi_grain_richness(p.hll_base, p.hll_precision, p.num_threads)) {
+        richness.push_back(g.mean_richness);
+        richness.push_back(g.std_error);
+      }
+      write_row(out_grains, gen, richness);
+    } else if (p.grains) {
+      std::vector<double> richness;
+      for (const auto& g : sim.multi_grain_stats(p.num_threads)) richness.push_back(g.mean_richness);
+      write_row(out_grains, gen, richness);
+    }
+  };
+
+  std::unique_ptr< tiled_engine<DISPERSAL> > engine;
+  std::unique_ptr< kmc_engine<DISPERSAL> > kmc;
+  std::unique_ptr< wright_fisher_engine<DISPERSAL> > wright_fisher;
+  if (p.wright_fisher) {
+    wright_fisher = std::make_unique< wright_fisher_engine<DISPERSAL> >(sim, p.num_threads);
+  } else if (p.kmc) {
+    kmc = std::make_unique< kmc_engine<DISPERSAL> >(sim);
+    if (!kmc->is_available()) {
+      std::cerr << "dispersal reaches too far for --kmc, running serially\n";
+    }
+  } else if (p.num_threads > 1) {
+    engine = std::make_unique< tiled_engine<DISPERSAL> >(sim, p.num_threads);
+    if (!engine->is_parallel()) {
+      std::cerr << "dispersal reaches too far for tiling, running serially\n";
+    }
+  }
+  std::vector<size_t> events_per_thread(std::max<size_t>(1, p.num_threads), 0);
+
+  record();
+  auto start = std::chrono::steady_clock::now();
+  while (sim.t < total_events) {
+    size_t next_output = std::min(total_events, sim.t + output_step);
+    if (wright_fisher) {
+      wright_fisher->run(next_output - sim.t);
+      events_per_thread[0] = sim.t;
+    } else if (kmc) {
+      kmc->run(next_output - sim.t);
+      events_per_thread[0] = sim.t;
+    } else if (engine) {
+      auto stats = engine->run(next_output - sim.t);
+      for (size_t i = 0; i < stats.events_per_thread.size(); ++i) {
+        events_per_thread[i] += stats.events_per_thread[i];
+      }
+    } else {
+      while (sim.t < next_output) {
+        sim.update();
+      }
+      events_per_thread[0] = sim.t;
+    }
+    record();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  if (p.pcf) {
+    std::ofstream out_pcf(p.prefix + "_pcf.txt");
+    auto f = sim.conspecific_correlation(16, 10000, p.num_threads);
+    out_pcf << "r\tF\tF_fft\tF_tail\ttail_error\n";
+    for (size_t i = 0; i < f.r.size(); ++i) {
+      out_pcf << f.r[i] << "\t" << f.F[i] << "\t" << f.F_fft[i] << "\t"
+              << f.F_tail[i] << "\t" << f.tail_error[i] << "\n";
+    }
+  }
+
+  if (p.grains) {
+    // one row per species: abundance, then the fraction of blocks it
+    // occupies at each grain
+    std::ofstream out_occupancy(p.prefix + "_occupancy.txt");
+    auto grains = sim.multi_grain_stats(p.num_threads);
+    out_occupancy << "abundance";
+    for (const auto& g : grains) out_occupancy << "\t" << g.side;
+    out_occupancy << "\n";
+    for (size_t s = 0; s < grains[0].occupancy.size(); ++s) {
+      if (sim.get_abundance(static_cast<species_index>(s)) == 0) continue;
+      out_occupancy << sim.get_abundance(static_cast<species_index>(s));
+      for (const auto& g : grains) out_occupancy << "\t" << 1.0 * g.occupancy[s] / g.num_blocks;
+      out_occupancy << "\n";
+    }
+  }
+
+  double secs = std::chrono::duration<double>(end - start).count();
+  std::cerr << "seed " << p.seed << ": ran " << sim.t << " events in " << secs << " s ("
+            << (secs > 0 ? sim.t / secs : 0.0) << " events/s)\n";
+  if (wright_fisher) {
+    std::cerr << "wright-fisher: " << wright_fisher->num_blocks() << " blocks on "
+              << std::max<size_t>(1, p.num_threads) << " threads\n";
+  }
+  if (engine && engine->is_parallel()) {
+    std::cerr << engine->num_tiles() << " tiles\n";
+    for (size_t i = 0; i < events_per_thread.size(); ++i) {
+      std::cerr << "thread " << i << ": " << events_per_thread[i] << " events, "
+                << (secs > 0 ? events_per_thread[i] / secs : 0.0) << " events/s\n";
+    }
+  }
+  return 0;
+}
+
+// dispersal that spans the landscape: no grid, see well_mixed.h
+int run_well_mixed(const batch_params& p) {
+  auto make_sim = [&p](size_t replicate) {
+    return std::make_unique< well_mixed_simulation >(p.L, p.spec_rate, p.migr_rate, p.Jm,
+                                                     p.disp_range, p.theta, p.init_mono_dom,
+                                                     p.seed, replicate, p.meta_mode,
+                                                     p.meta_rate, p.meta_background);
+  };
+  if (p.num_replicates > 1) return run_replicates<well_mixed_simulation>(p, make_sim);
+
+  std::ofstream out_richness(p.prefix + "_richness.txt");
+  std::ofstream out_octaves(p.prefix + "_octaves.txt");
+  std::ofstream out_rank_abund(p.prefix + "_rank_abund.txt");
+  if (!out_richness || !out_octaves || !out_rank_abund) {
+    std::cerr << "could not open output files with prefix " << p.prefix << "\n";
+    return 1;
+  }
+
+  auto sim = make_sim(0);
+  const double events_per_generation = static_cast<double>(p.L * p.L);
+  const size_t total_events = static_cast<size_t>(p.generations * events_per_generation);
+  const size_t output_step = std::max<size_t>(1, static_cast<size_t>(p.interval * events_per_generation));
+
+  out_richness << "generation\tnum_species\n";
+  auto record = [&]() {
+    sim->update_stats();
+    double gen = sim->t / events_per_generation;
+    out_richness << gen << "\t" << sim->num_species() << "\n";
+    write_row(out_octaves, gen, sim->get_local_octaves());
+    write_row(out_rank_abund, gen, sim->rank_abund_curve);
+  };
+
+  record();
+  auto start = std::chrono::steady_clock::now();
+  while (sim->t < total_events) {
+    size_t next_output = std::min(total_events, sim->t + output_step);
+    while (sim->t < next_output) {
+      sim->update();
+    }
+    record();
+  }
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << "seed " << p.seed << ": ran " << sim->t << " events in " << secs << " s ("
+            << (secs > 0 ? sim->t / secs : 0.0) << " events/s), well mixed, "
+            << sim->num_slots() << " species slots\n";
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  batch_params p;
+  if (!parse_args(argc, argv, p)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  meta_cache::set_directory(p.cache_dir);
+  meta_cache::set_max_bytes(static_cast<uint64_t>(p.cache_max_mib) << 20);
+
+  // a radial kernel that spans the landscape leaves nothing spatial to
+  // simulate, unless spatial output is asked for
+  const bool radial = p.kernel != "von_neumann" && p.kernel != "moore";
+  const bool needs_grid = p.spatial || p.grains || p.pcf || p.coalescence || p.kmc ||
+                          p.wright_fisher;
+  if (radial && p.disp_range >= p.L && !needs_grid) {
+    std::cerr << "dispersal spans the landscape: running the well-mixed model\n";
+    return run_well_mixed(p);
+  }
+
+  if (p.kernel == "polar")       return run<polar_kernel>(p);
+  if (p.kernel == "gaussian")    return run<gaussian_kernel>(p);
+  if (p.kernel == "exponential") return run<negative_exponential_kernel>(p);
+  if (p.kernel == "fat_tailed")  return run<fat_tailed_kernel>(p);
+  if (p.kernel == "cauchy")      return run<cauchy_kernel>(p);
+  if (p.kernel == "von_neumann") return run<von_neumann_kernel>(p);
+  if (p.kernel == "moore")       return run<moore_kernel>(p);
+
+  std::cerr << "unknown kernel " << p.kernel << "\n";
+  print_usage(argv[0]);
+  return 1;
+}
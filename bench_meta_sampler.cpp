@@ -0,0 +1,96 @@
+//
+//  bench_meta_sampler.cpp
+//  neutralizer_bench
+//
+//  Microbenchmark of metacommunity immigration: the alias table used by
+//  simulation::get_species_from_meta_community() against the previous
+//  std::lower_bound search over a cumulative distribution.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+#include "rand_t.h"
+#include "alias_table.h"
+
+// heavy-tailed abundances, roughly like a metacommunity built with large theta
+std::vector<int> make_abundances(size_t num_species, rnd_t& rndgen) {
+  std::vector<int> abund(num_species);
+  for (auto& i : abund) {
+    double u = 1.0 - static_cast<double>(rndgen.uniform());
+    i = static_cast<int>(std::min(1e6, std::ceil(1.0 / u)));
+  }
+  return abund;
+}
+
+struct cdf_sampler {
+  std::vector<double> cdf_;
+
+  explicit cdf_sampler(const std::vector<int>& abund) {
+    double cumsum = 0.0;
+    for (auto i : abund) {
+      cumsum += i;
+      cdf_.push_back(cumsum);
+    }
+  }
+
+  size_t sample(rnd_t& rndgen) const {
+    double p = rndgen.uniform() * cdf_.back();
+    size_t index = std::distance(cdf_.cbegin(), std::lower_bound(cdf_.cbegin(), cdf_.cend(), p));
+    return std::min(index, cdf_.size() - 1);
+  }
+};
+
+template <typename SAMPLER>
+double time_draws(const SAMPLER& sampler, size_t num_draws,
+                  size_t seed, std::vector<double>& freq) {
+  rnd_t rndgen(seed);
+  std::vector<size_t> counts(freq.size(), 0);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_draws; ++i) {
+    counts[sampler.sample(rndgen)]++;
+  }
+  auto end = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < freq.size(); ++i) {
+    freq[i] = 1.0 * counts[i] / num_draws;
+  }
+  return std::chrono::duration<double, std::nano>(end - start).count() / num_draws;
+}
+
+int main(int argc, char* argv[]) {
+  size_t num_draws = 10000000;
+  if (argc > 1) num_draws = std::stoul(argv[1]);
+
+  rnd_t rndgen(42);
+  std::cout << std::setw(10) << "species"
+            << std::setw(14) << "cdf ns/draw"
+            << std::setw(16) << "alias ns/draw"
+            << std::setw(10) << "speedup"
+            << std::setw(18) << "max |freq diff|" << "\n";
+
+  for (size_t num_species : {100, 1000, 10000, 100000, 1000000}) {
+    auto abund = make_abundances(num_species, rndgen);
+    cdf_sampler cdf(abund);
+    alias_table alias(abund);
+
+    std::vector<double> freq_cdf(num_species), freq_alias(num_species);
+    double t_cdf = time_draws(cdf, num_draws, 1, freq_cdf);
+    double t_alias = time_draws(alias, num_draws, 2, freq_alias);
+
+    double max_diff = 0.0;
+    for (size_t i = 0; i < num_species; ++i) {
+      max_diff = std::max(max_diff, std::abs(freq_cdf[i] - freq_alias[i]));
+    }
+
+    std::cout << std::setw(10) << num_species
+              << std::setw(14) << t_cdf
+              << std::setw(16) << t_alias
+              << std::setw(10) << t_cdf / t_alias
+              << std::setw(18) << max_diff << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,151 @@
+//
+//  block_aggregation.h
+//  neutralizer_backbone
+//
+//  Species richness and occupancy at every grain 2^k x 2^k, from one
+//  bottom-up pass over a quadtree of blocks.
+//
+
+#ifndef block_aggregation_h
+#define block_aggregation_h
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include "cell.h"
+
+struct grain_stats {
+  size_t side = 0;                    // blocks are side x side cells
+  size_t num_blocks = 0;              // complete blocks tiling the world
+  double mean_richness = 0.0;         // species per block
+  std::vector<uint32_t> occupancy;    // blocks holding each registry entry
+};
+
+// Level k holds the species set of every block of side 2^k whose corner
+// is a multiple of 2^k, for the blocks that fit in the L x L world. The
+// set of a block is the union of the sets of its four children at level
+// k - 1, so every level costs O(N) and all levels O(N log N), instead of
+// rescanning the world per grain.
+//
+// A set is a run of registry indices in a flat array. Unions go through a
+// stamped marker array: an entry is new to the block if its stamp differs
+// from the block's, so marking takes O(1) and nothing is ever cleared.
+// Blocks of one level are independent and are split over num_threads
+// threads, each with its own marker array and occupancy counts.
+class block_aggregation {
+public:
+  block_aggregation(const std::vector<species_index>& world, size_t L,
+                    size_t num_registry, size_t num_threads = 1) :
+    world_(world), L_(L), num_registry_(num_registry),
+    num_threads_(std::max<size_t>(1, num_threads)) {}
+
+  // grains 1, 2, 4, ... up to the largest power of two <= L
+  std::vector<grain_stats> run() {
+    std::vector<grain_stats> out;
+    out.push_back(level_zero());
+
+    level prev;
+    for (size_t side = 2; side <= L_; side *= 2) {
+      level next = merge(prev, side);
+      out.push_back(stats_of(next, side));
+      prev = std::move(next);
+    }
+    return out;
+  }
+
+private:
+  const std::vector<species_index>& world_;
+  size_t L_;
+  size_t num_registry_;
+  size_t num_threads_;
+
+  struct level {
+    size_t per_side = 0;                // blocks per side
+    std::vector<size_t> offset;         // set of block b: [offset[b], offset[b + 1])
+    std::vector<species_index> members;
+    std::vector<uint32_t> occupancy;
+  };
+
+  grain_stats level_zero() const {
+    grain_stats g;
+    g.side = 1;
+    g.num_blocks = L_ * L_;
+    g.mean_richness = L_ > 0 ? 1.0 : 0.0;
+    g.occupancy.assign(num_registry_, 0);
+    for (auto s : world_) g.occupancy[s]++;
+    return g;
+  }
+
+  // species of child (cx, cy) of the previous level; level 1 reads cells
+  template <typename F>
+  void for_each_in_child(const level& prev, size_t cx, size_t cy, F f) const {
+    if (prev.per_side == 0) {
+      f(world_[cx * L_ + cy]);
+      return;
+    }
+    const size_t b = cx * prev.per_side + cy;
+    for (size_t i = prev.offset[b]; i < prev.offset[b + 1]; ++i) f(prev.members[i]);
+  }
+
+  level merge(const level& prev, size_t side) const {
+    level next;
+    next.per_side = L_ / side;
+    const size_t num_blocks = next.per_side * next.per_side;
+    const size_t num_threads = std::min(num_threads_, std::max<size_t>(1, num_blocks));
+
+    // each thread builds the sets of a contiguous range of blocks
+    std::vector<std::vector<species_index>> members(num_threads);
+    std::vector<std::vector<size_t>> sizes(num_threads);
+    std::vector<std::vector<uint32_t>> occupancy(num_threads);
+
+    auto work = [&](size_t t) {
+      const size_t b0 = t * num_blocks / num_threads;
+      const size_t b1 = (t + 1) * num_blocks / num_threads;
+      std::vector<uint32_t> stamp(num_registry_, 0);
+      occupancy[t].assign(num_registry_, 0);
+      for (size_t b = b0; b < b1; ++b) {
+        const uint32_t mark = static_cast<uint32_t>(b - b0 + 1);
+        const size_t bx = b / next.per_side;
+        const size_t by = b % next.per_side;
+        const size_t before = members[t].size();
+        for (size_t dx = 0; dx < 2; ++dx) {
+          for (size_t dy = 0; dy < 2; ++dy) {
+            for_each_in_child(prev, 2 * bx + dx, 2 * by + dy, [&](species_index s) {
+              if (stamp[s] == mark) return;
+              stamp[s] = mark;
+              members[t].push_back(s);
+              occupancy[t][s]++;
+            });
+          }
+        }
+        sizes[t].push_back(members[t].size() - before);
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; ++t) threads.emplace_back(work, t);
+    work(0);
+    for (auto& i : threads) i.join();
+
+    next.offset.push_back(0);
+    next.occupancy.assign(num_registry_, 0);
+    for (size_t t = 0; t < num_threads; ++t) {
+      for (auto n : sizes[t]) next.offset.push_back(next.offset.back() + n);
+      next.members.insert(next.members.end(), members[t].begin(), members[t].end());
+      for (size_t s = 0; s < num_registry_; ++s) next.occupancy[s] += occupancy[t][s];
+    }
+    return next;
+  }
+
+  grain_stats stats_of(level& l, size_t side) const {
+    grain_stats g;
+    g.side = side;
+    g.num_blocks = l.per_side * l.per_side;
+    g.mean_richness = g.num_blocks > 0 ? static_cast<double>(l.members.size()) / g.num_blocks : 0.0;
+    g.occupancy = std::move(l.occupancy);
+    return g;
+  }
+};
+
+#endif /* block_aggregation_h */
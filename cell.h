@@ -11,19 +11,24 @@
 
 #include "rand_t.h"
 #include <array>
+#include <cstdint>
 #include <cassert>
 
 struct species {
   size_t id_;
-  int count_;
+  size_t count_;
 
-  species(int count, rnd_t& rndgen) : count_(count) {
+  species(size_t count, rnd_t& rndgen) : count_(count) {
     id_ = rndgen.random_number(static_cast<size_t>(1e10));
     for(int i = 0; i < 3; ++i) {
       color_[i] = rndgen.random_number(256); // in range [0, 255]
     }
   }
 
+  // a species stored before, see meta_cache.h
+  species(size_t count, size_t id, const std::array<size_t, 3>& color) :
+    id_(id), count_(count), color_(color) {}
+
   species() {
     count_ = 0;
     // fake data, using default rng:
@@ -52,38 +57,10 @@ private:
 
 
 
-struct cell {
-  species local_species;
-  size_t x_;
-  size_t y_;
-
-  cell() {
-    local_species = species();
-  }
-
-  void set_species(const species& target_species) {
-    local_species = target_species;
-  }
-
-  const species& get_species() const noexcept {
-    return local_species;
-  }
-
-  int get_species_id() const noexcept {
-    return local_species.id_;
-  }
-
-  void set_xy(size_t pos, size_t row_size) {
-    x_ = pos / row_size;
-    y_ = pos % row_size;
-  }
-
-  // we assume we have a fixed grid
-  cell(cell&&) = delete;
-  const cell& operator=(cell&&) = delete;
-  cell(const cell&) = delete;
-  const cell& operator=(const cell&) = delete;
-};
+// the world only stores an index into the species registry per cell,
+// all per-species data (id, colour, metacommunity abundance) is kept once
+// in the registry.
+using species_index = uint32_t;
 
 
 #endif /* cell_h */
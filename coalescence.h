@@ -0,0 +1,273 @@
+//
+//  coalescence.h
+//  neutralizer_backbone
+//
+//  Equilibrium community of a simulation_t by spatially explicit
+//  coalescence (Rosindell et al. 2008), instead of a forward burn-in, and
+//  from the same genealogy for any higher speciation rate.
+//
+
+#ifndef coalescence_h
+#define coalescence_h
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "cell.h"
+#include "rand_t.h"
+
+template <typename DISPERSAL> class simulation_t;
+
+// The genealogy of all cells as an arena of nodes. Nodes 0 .. N - 1 are the
+// cells; every coalescence appends a node that is the parent of the two
+// lineages that met, so a parent always comes after its children. length
+// is the number of dispersal steps on the branch from a node to its
+// parent; a root has no parent and ends in speciation or immigration.
+struct coalescence_tree {
+  static constexpr uint32_t speciation_root = ~uint32_t(0);
+  static constexpr uint32_t migration_root = ~uint32_t(0) - 1;
+
+  struct node {
+    uint32_t parent;
+    uint32_t length;
+  };
+
+  std::vector<node> nodes;
+
+  static bool is_root(const node& n) noexcept {
+    return n.parent >= migration_root;
+  }
+};
+
+// the community for one speciation rate: species are numbered 0, 1, ...
+// per snapshot
+struct coalescence_snapshot {
+  double spec_rate = 0.0;
+  std::vector<uint32_t> species;      // per cell
+  std::vector<size_t> abundance;      // per species
+};
+
+struct coalescence_stats {
+  size_t steps = 0;           // lineage moves, speciations and immigrations
+  size_t num_roots = 0;
+  double seconds = 0.0;
+};
+
+// Backward in time, every cell of the Moran process is replaced at rate
+// one, independently of the others, so the lineages of a set of cells
+// jump in the order of a uniformly chosen lineage per step. A jump is what
+// the forward update() does for the cell the lineage sits on: with
+// probability prob_same it moves to the parent picked by the dispersal
+// kernel, merging with the lineage already there, if any; otherwise the
+// lineage ends in speciation or, with rel_prob_spec's complement, in
+// immigration. Starting from all L x L cells this runs until every
+// lineage has ended, which is the equilibrium of the forward process:
+// no burn-in, and as lineages merge the work shrinks quickly.
+//
+// run() then gives every root a species, new_species() for a speciation
+// and get_species_from_meta_community() for an immigrant, so every
+// metacommunity mode works, and fills world from the roots downwards. The
+// lineages run on stream (seed, replicate, 0, 3) of rnd_t. t is left as
+// it is.
+//
+// The tree also holds the community for any speciation rate s above the
+// simulation's s0, at the same migration rate m. Every dispersal step of
+// the tree is one that did not speciate at s0 and did not immigrate; at s
+// it speciates with probability q = (s - s0) / (1 - s0 - m) instead, so a
+// branch of length n carries a speciation with probability 1 - (1 - q)^n,
+// and then all cells below it form a new species. sweep() makes these
+// snapshots from the tree alone, one linear pass per rate, in parallel.
+// A branch speciates if its uniform, drawn once on stream (seed,
+// replicate, 0, 4), is below that probability; with the same uniforms for
+// every rate, the species of a higher rate are nested in those of a lower
+// one.
+template <typename DISPERSAL>
+class coalescence_engine {
+public:
+  static constexpr size_t stream_step = 3;
+  static constexpr size_t sweep_stream_step = 4;
+
+  explicit coalescence_engine(simulation_t<DISPERSAL>& sim) : sim_(sim) {}
+
+  coalescence_stats run() {
+    auto start = std::chrono::steady_clock::now();
+    coalescence_stats stats = build_tree();
+    fill_world();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+  }
+
+  const coalescence_tree& tree() const noexcept {
+    return tree_;
+  }
+
+  // snapshots for each of spec_rates, after run(); rates below the
+  // simulation's speciation rate are taken as that rate
+  std::vector<coalescence_snapshot> sweep(const std::vector<double>& spec_rates,
+                                          size_t num_threads = 1) {
+    const size_t num_nodes = tree_.nodes.size();
+    if (branch_uniform_.size() != num_nodes) {
+      rnd_t rndgen(sim_.seed_, sim_.replicate_, 0, sweep_stream_step);
+      branch_uniform_.resize(num_nodes);
+      for (auto& i : branch_uniform_) i = rndgen.uniform_double();
+    }
+
+    std::vector<coalescence_snapshot> out(spec_rates.size());
+    num_threads = std::min(std::max<size_t>(1, num_threads), std::max<size_t>(1, out.size()));
+    auto work = [&](size_t t) {
+      for (size_t i = t; i < out.size(); i += num_threads) out[i] = snapshot(spec_rates[i]);
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; ++t) threads.emplace_back(work, t);
+    work(0);
+    for (auto& i : threads) i.join();
+    return out;
+  }
+
+private:
+  static constexpr uint32_t no_lineage = ~uint32_t(0);
+
+  simulation_t<DISPERSAL>& sim_;
+  coalescence_tree tree_;
+  // registry index given to every node by fill_world
+  std::vector<species_index> species_of_;
+  // one uniform per branch for sweep()
+  std::vector<double> branch_uniform_;
+
+  struct lineage {
+    uint32_t pos;
+    uint32_t node;   // node whose branch is growing
+  };
+
+  coalescence_stats build_tree() {
+    coalescence_stats stats;
+    const size_t L = sim_.L;
+    const size_t N = L * L;
+    rnd_t rndgen(sim_.seed_, sim_.replicate_, 0, stream_step);
+
+    auto& nodes = tree_.nodes;
+    nodes.clear();
+    nodes.reserve(2 * N);
+    nodes.resize(N, coalescence_tree::node{0, 0});
+
+    // active lineages, and which of them (if any) sits on every cell
+    std::vector<lineage> active(N);
+    std::vector<uint32_t> lineage_at(N);
+    for (size_t i = 0; i < N; ++i) {
+      active[i] = lineage{static_cast<uint32_t>(i), static_cast<uint32_t>(i)};
+      lineage_at[i] = static_cast<uint32_t>(i);
+    }
+
+    // removes active[i] by moving the last lineage into its slot
+    auto remove = [&](size_t i) {
+      lineage_at[active[i].pos] = no_lineage;
+      active[i] = active.back();
+      active.pop_back();
+      if (i < active.size()) lineage_at[active[i].pos] = static_cast<uint32_t>(i);
+    };
+
+    while (!active.empty()) {
+      stats.steps++;
+      const size_t i = rndgen.random_number(active.size());
+      lineage& a = active[i];
+
+      if (!rndgen.below_threshold(sim_.prob_same_threshold_)) {
+        nodes[a.node].parent = rndgen.below_threshold(sim_.rel_prob_spec_threshold_)
+                               ? coalescence_tree::speciation_root
+                               : coalescence_tree::migration_root;
+        stats.num_roots++;
+        remove(i);
+        continue;
+      }
+
+      nodes[a.node].length++;
+      const auto target = static_cast<uint32_t>(sim_.dispersal_(a.pos / L, a.pos % L, rndgen));
+      if (target == a.pos) continue;
+      const uint32_t j = lineage_at[target];
+      if (j == no_lineage) {
+        lineage_at[a.pos] = no_lineage;
+        lineage_at[target] = static_cast<uint32_t>(i);
+        a.pos = target;
+        continue;
+      }
+      // a and the lineage on target share their parent from here on
+      const auto merged = static_cast<uint32_t>(nodes.size());
+      nodes[a.node].parent = merged;
+      nodes[active[j].node].parent = merged;
+      nodes.push_back(coalescence_tree::node{0, 0});
+      active[j].node = merged;
+      remove(i);
+    }
+    return stats;
+  }
+
+  void fill_world() {
+    const auto& nodes = tree_.nodes;
+    auto& species_of = species_of_;
+    species_of.resize(nodes.size());
+    // parents come after their children
+    for (size_t n = nodes.size(); n-- > 0; ) {
+      const auto parent = nodes[n].parent;
+      if (parent == coalescence_tree::speciation_root) {
+        species_of[n] = sim_.new_species();
+      } else if (parent == coalescence_tree::migration_root) {
+        species_of[n] = sim_.get_species_from_meta_community();
+      } else {
+        species_of[n] = species_of[parent];
+      }
+    }
+    for (size_t i = 0; i < sim_.world.size(); ++i) sim_.world[i] = species_of[i];
+    sim_.recount();
+  }
+
+  coalescence_snapshot snapshot(double spec_rate) const {
+    const auto& nodes = tree_.nodes;
+    const double s0 = (1.0 - sim_.prob_same) * sim_.rel_prob_spec;
+    const double m = (1.0 - sim_.prob_same) * (1.0 - sim_.rel_prob_spec);
+    const double q = std::min(1.0, std::max(0.0, (spec_rate - s0) / (1.0 - s0 - m)));
+    const double log_no_speciation = std::log1p(-q);
+
+    // label of every node; immigrants of one metacommunity species share
+    // a label
+    constexpr uint32_t unset = ~uint32_t(0);
+    std::vector<uint32_t> label(nodes.size());
+    std::vector<uint32_t> label_of_registry(sim_.species_registry.size(), unset);
+    uint32_t num_species = 0;
+    for (size_t n = nodes.size(); n-- > 0; ) {
+      const auto& node = nodes[n];
+      const bool speciates = node.length > 0 && q > 0.0 &&
+                             branch_uniform_[n] < -std::expm1(node.length * log_no_speciation);
+      if (speciates || node.parent == coalescence_tree::speciation_root) {
+        label[n] = num_species++;
+      } else if (node.parent == coalescence_tree::migration_root) {
+        auto& l = label_of_registry[species_of_[n]];
+        if (l == unset) l = num_species++;
+        label[n] = l;
+      } else {
+        label[n] = label[node.parent];
+      }
+    }
+
+    // a speciation above a node whose cells all speciated again further
+    // down leaves its label unused; number the labels that are in use
+    coalescence_snapshot out;
+    out.spec_rate = std::max(spec_rate, s0);
+    out.species.resize(sim_.world.size());
+    std::vector<uint32_t> compact(num_species, unset);
+    for (size_t i = 0; i < out.species.size(); ++i) {
+      auto& c = compact[label[i]];
+      if (c == unset) {
+        c = static_cast<uint32_t>(out.abundance.size());
+        out.abundance.push_back(0);
+      }
+      out.species[i] = c;
+      out.abundance[c]++;
+    }
+    return out;
+  }
+};
+
+#endif /* coalescence_h */
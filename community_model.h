@@ -0,0 +1,89 @@
+//
+//  community_model.h
+//  neutralizer_backbone
+//
+//  What the GUI needs from a model, so that it can run the spatial
+//  simulation and the well-mixed one alike.
+//
+
+#ifndef community_model_h
+#define community_model_h
+
+#include <vector>
+#include <array>
+#include <utility>
+#include <cstddef>
+
+class community_model {
+public:
+  virtual ~community_model() {}
+
+  // num_events Moran events, without a virtual call per event
+  virtual void run(size_t num_events) = 0;
+  virtual size_t update_stats() = 0;
+
+  virtual size_t time() const = 0;
+  virtual size_t side() const = 0;
+  virtual int num_species() const = 0;
+  virtual std::array<size_t, 3> get_color(size_t pos) const = 0;
+  virtual const std::vector<double>& rank_abund_curve() const = 0;
+  virtual std::vector<int> get_meta_octaves() = 0;
+  virtual std::vector<int> get_local_octaves() const = 0;
+  virtual void update_species_area(std::vector<double>& area,
+                                   std::vector<double>& num_species) = 0;
+};
+
+// SIM is a simulation_t or a well_mixed_simulation, built from the same
+// constructor arguments
+template <typename SIM>
+class community_model_of : public community_model {
+public:
+  template <typename... ARGS>
+  explicit community_model_of(ARGS&&... args) : sim_(std::forward<ARGS>(args)...) {}
+
+  void run(size_t num_events) override {
+    for (size_t i = 0; i < num_events; ++i) sim_.update();
+  }
+
+  size_t update_stats() override {
+    return sim_.update_stats();
+  }
+
+  size_t time() const override {
+    return sim_.t;
+  }
+
+  size_t side() const override {
+    return sim_.L;
+  }
+
+  int num_species() const override {
+    return sim_.num_species();
+  }
+
+  std::array<size_t, 3> get_color(size_t pos) const override {
+    return sim_.get_color(pos);
+  }
+
+  const std::vector<double>& rank_abund_curve() const override {
+    return sim_.rank_abund_curve;
+  }
+
+  std::vector<int> get_meta_octaves() override {
+    return sim_.get_meta_octaves();
+  }
+
+  std::vector<int> get_local_octaves() const override {
+    return sim_.get_local_octaves();
+  }
+
+  void update_species_area(std::vector<double>& area,
+                           std::vector<double>& num_species) override {
+    sim_.update_species_area(area, num_species);
+  }
+
+private:
+  SIM sim_;
+};
+
+#endif /* community_model_h */
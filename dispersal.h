@@ -0,0 +1,349 @@
+//
+//  dispersal.h
+//  neutralizer_backbone
+//
+//  Dispersal kernels, used as the template policy of simulation_t. A kernel
+//  is constructed from (dispersal_range, L) and returns, for a cell at
+//  (x, y), the position of the parent on the torus.
+//
+
+#ifndef dispersal_h
+#define dispersal_h
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include "rand_t.h"
+#include "alias_table.h"
+
+// Radial kernels: an integer distance d >= 1 is drawn from a ring
+// distribution, the direction is uniform and the target is rounded to the
+// nearest cell (the original polar scheme of the Neutralizer). For every
+// distance the rounding cuts the circle into arcs that map onto the same
+// cell; the arc lengths give the exact probability of every offset, so a
+// draw becomes a single alias lookup. Offsets are stored modulo L and
+// offsets that wrap back onto the source are dropped (they used to be
+// redrawn). If the table would be too large, the ring distance is drawn
+// from an alias table and rounded with sin/cos instead.
+class radial_dispersal {
+public:
+  // tables above this many cells are not built
+  static constexpr size_t max_table_cells = size_t{1} << 24;
+
+  radial_dispersal() {}
+
+  // prob_dist[d] is the probability of moving distance d; prob_dist[0]
+  // (staying on the source) is ignored.
+  radial_dispersal(const std::vector<double>& prob_dist, size_t L) {
+    build(prob_dist, L);
+  }
+
+  void build(const std::vector<double>& prob_dist, size_t L) {
+    L_ = L;
+    offsets_.clear();
+    offset_sampler_ = alias_table();
+    max_dist_ = prob_dist.empty() ? 0 : static_cast<int>(prob_dist.size()) - 1;
+    reach_ = static_cast<size_t>(max_dist_);
+    ring_prob_ = prob_dist;
+    if (!ring_prob_.empty()) ring_prob_[0] = 0.0;
+    ring_sampler_.build(ring_prob_);
+    if (L < 2 || max_dist_ < 1) return;
+
+    // cells reachable in one step, before wrapping around the torus
+    const size_t width = std::min(L, static_cast<size_t>(2 * max_dist_ + 1));
+    if (width * width > max_table_cells) return;
+
+    const bool wraps = width == L;
+    const int shift = wraps ? 0 : max_dist_;
+    const int iL = static_cast<int>(L);
+    std::vector<double> mass(width * width, 0.0);
+    auto add_mass = [&](int dx, int dy, double p) {
+      if (wraps) {
+        dx = ((dx % iL) + iL) % iL;
+        dy = ((dy % iL) + iL) % iL;
+      } else {
+        dx += shift;
+        dy += shift;
+      }
+      mass[dx * width + dy] += p;
+    };
+
+    for (int d = 1; d <= max_dist_; ++d) {
+      if (ring_prob_[d] <= 0.0) continue;
+      auto arcs = arc_boundaries(d);
+      for (size_t i = 0; i + 1 < arcs.size(); ++i) {
+        double len = arcs[i + 1] - arcs[i];
+        if (len <= 0.0) continue;
+        double mid = 0.5 * (arcs[i] + arcs[i + 1]);
+        int dx = static_cast<int>(std::round(std::cos(mid) * d));
+        int dy = static_cast<int>(std::round(std::sin(mid) * d));
+        add_mass(dx, dy, ring_prob_[d] * len / two_pi);
+      }
+    }
+
+    std::vector<double> weights;
+    for (size_t i = 0; i < width; ++i) {
+      for (size_t j = 0; j < width; ++j) {
+        double p = mass[i * width + j];
+        if (p <= 0.0) continue;
+        int dx = static_cast<int>(i) - shift;
+        int dy = static_cast<int>(j) - shift;
+        dx = ((dx % iL) + iL) % iL;
+        dy = ((dy % iL) + iL) % iL;
+        if (dx == 0 && dy == 0) continue; // lands on the source: redrawn
+        offsets_.push_back(offset{static_cast<uint32_t>(dx), static_cast<uint32_t>(dy)});
+        weights.push_back(p);
+      }
+    }
+    offset_sampler_.build(weights);
+
+    reach_ = 0;
+    for (const auto& o : offsets_) {
+      reach_ = std::max(reach_, static_cast<size_t>(std::min<uint32_t>(o.dx, static_cast<uint32_t>(L) - o.dx)));
+      reach_ = std::max(reach_, static_cast<size_t>(std::min<uint32_t>(o.dy, static_cast<uint32_t>(L) - o.dy)));
+    }
+  }
+
+  bool is_tabulated() const noexcept {
+    return !offsets_.empty();
+  }
+
+  // number of tabulated offsets (0 if sampled with sin/cos)
+  size_t size() const noexcept {
+    return offsets_.size();
+  }
+
+  // largest displacement along either axis (shortest way round the torus)
+  size_t reach() const noexcept {
+    return reach_;
+  }
+
+  // target cell for a parent of (source_x, source_y), wrapped on the torus
+  size_t operator()(size_t source_x, size_t source_y, rnd_t& rndgen) const {
+    if (!offsets_.empty()) {
+      const auto& o = offsets_[offset_sampler_.sample(rndgen)];
+      return wrap(source_x + o.dx, source_y + o.dy);
+    }
+    return sample_polar(source_x, source_y, rndgen);
+  }
+
+  // parents of the n cells (source_x, y0), ..., (source_x, y0 + n - 1),
+  // y0 + n <= L, as one batch: all offsets are drawn first, the positions
+  // follow in a loop without random draws or branches
+  void fill_row(size_t source_x, size_t y0, size_t n, uint32_t* target, rnd_t& rndgen) const {
+    if (offsets_.empty()) {
+      for (size_t i = 0; i < n; ++i) {
+        target[i] = static_cast<uint32_t>(sample_polar(source_x, y0 + i, rndgen));
+      }
+      return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      target[i] = static_cast<uint32_t>(offset_sampler_.sample(rndgen));
+    }
+    for (size_t i = 0; i < n; ++i) {
+      const auto& o = offsets_[target[i]];
+      target[i] = static_cast<uint32_t>(wrap(source_x + o.dx, y0 + i + o.dy));
+    }
+  }
+
+private:
+  static constexpr double two_pi = 6.283185307179586;
+
+  // offsets are stored already reduced to [0, L)
+  struct offset {
+    uint32_t dx;
+    uint32_t dy;
+  };
+
+  size_t L_ = 0;
+  int max_dist_ = 0;
+  size_t reach_ = 0;
+  std::vector<offset> offsets_;
+  alias_table offset_sampler_;
+  std::vector<double> ring_prob_;
+  alias_table ring_sampler_;
+
+  size_t wrap(size_t x, size_t y) const {
+    x -= L_ & (0 - static_cast<size_t>(x >= L_));
+    y -= L_ & (0 - static_cast<size_t>(y >= L_));
+    return x * L_ + y;
+  }
+
+  size_t sample_polar(size_t source_x, size_t source_y, rnd_t& rndgen) const {
+    const int iL = static_cast<int>(L_);
+    while (true) {
+      int distance = static_cast<int>(ring_sampler_.sample(rndgen));
+      double dir = rndgen.uniform() * two_pi;
+      int dx = static_cast<int>(std::round(std::cos(dir) * distance)) % iL;
+      int dy = static_cast<int>(std::round(std::sin(dir) * distance)) % iL;
+      if (dx < 0) dx += iL;
+      if (dy < 0) dy += iL;
+      if (dx != 0 || dy != 0) {
+        return wrap(source_x + dx, source_y + dy);
+      }
+    }
+  }
+
+  // angles in [0, 2 pi] at which round(d cos a) or round(d sin a) changes
+  static std::vector<double> arc_boundaries(int d) {
+    std::vector<double> arcs = {0.0, two_pi};
+    for (int k = -d - 1; k <= d; ++k) {
+      double v = (k + 0.5) / d;
+      if (v <= -1.0 || v >= 1.0) continue;
+      double a = std::acos(v);
+      arcs.push_back(a);
+      arcs.push_back(two_pi - a);
+      double b = std::asin(v);
+      if (b < 0.0) b += two_pi;
+      arcs.push_back(b);
+      arcs.push_back(0.5 * two_pi - std::asin(v));
+    }
+    std::sort(arcs.begin(), arcs.end());
+    return arcs;
+  }
+};
+
+// Ring distribution of a continuous radial kernel with cumulative distance
+// distribution F: distance d collects the mass of [d - 0.5, d + 0.5). The
+// tail is cut once it carries less than 1e-9 of the mass, or at distance L.
+template <typename CDF>
+std::vector<double> discretize_radial_cdf(CDF F, size_t L) {
+  std::vector<double> prob_dist(1, 0.0);
+  const int max_dist = static_cast<int>(std::max<size_t>(L, 1));
+  for (int d = 1; d <= max_dist; ++d) {
+    prob_dist.push_back(F(d + 0.5) - F(d - 0.5));
+    if (1.0 - F(d + 0.5) < 1e-9) break;
+  }
+  double total = 0.0;
+  for (auto p : prob_dist) total += p;
+  // kernel too narrow to ever leave the source: fall back to the neighbours
+  if (total <= 0.0) prob_dist = {0.0, 1.0};
+  return prob_dist;
+}
+
+// Default kernel: distance 1 + floor(u * dispersal_range), uniform direction.
+class polar_kernel : public radial_dispersal {
+public:
+  polar_kernel(double dispersal_range, size_t L) :
+    radial_dispersal(ring_probabilities(dispersal_range), L) {}
+
+  static std::vector<double> ring_probabilities(double dispersal_range) {
+    if (dispersal_range <= 0.0) return {0.0, 1.0};
+    const int max_dist = static_cast<int>(std::ceil(dispersal_range - 1e-12));
+    std::vector<double> prob_dist(max_dist + 1, 0.0);
+    for (int d = 1; d <= max_dist; ++d) {
+      prob_dist[d] = (std::min(static_cast<double>(d), dispersal_range) - (d - 1)) / dispersal_range;
+    }
+    return prob_dist;
+  }
+};
+
+// Bivariate normal displacement with standard deviation dispersal_range
+// along each axis (Rayleigh-distributed distance).
+class gaussian_kernel : public radial_dispersal {
+public:
+  gaussian_kernel(double dispersal_range, size_t L) :
+    radial_dispersal(ring_probabilities(dispersal_range, L), L) {}
+
+  static std::vector<double> ring_probabilities(double sigma, size_t L) {
+    sigma = std::max(sigma, 1e-6);
+    return discretize_radial_cdf([sigma](double r) {
+      return 1.0 - std::exp(-r * r / (2.0 * sigma * sigma));
+    }, L);
+  }
+};
+
+// Negative exponential kernel exp(-r / a) in the plane with a = dispersal_range
+// (mean distance 2a, Gamma(2, a) distributed distance).
+class negative_exponential_kernel : public radial_dispersal {
+public:
+  negative_exponential_kernel(double dispersal_range, size_t L) :
+    radial_dispersal(ring_probabilities(dispersal_range, L), L) {}
+
+  static std::vector<double> ring_probabilities(double a, size_t L) {
+    a = std::max(a, 1e-6);
+    return discretize_radial_cdf([a](double r) {
+      return 1.0 - (1.0 + r / a) * std::exp(-r / a);
+    }, L);
+  }
+};
+
+// Fat-tailed 2Dt kernel (Clark et al. 1999) with scale u = dispersal_range^2
+// and shape p: F(r) = 1 - (1 + r^2 / u)^-p. p = 0.5 is the 2D Cauchy kernel.
+class fat_tailed_kernel : public radial_dispersal {
+public:
+  fat_tailed_kernel(double dispersal_range, size_t L, double shape = 1.0) :
+    radial_dispersal(ring_probabilities(dispersal_range, L, shape), L) {}
+
+  static std::vector<double> ring_probabilities(double scale, size_t L, double shape) {
+    const double u = std::max(scale * scale, 1e-12);
+    return discretize_radial_cdf([u, shape](double r) {
+      return 1.0 - std::pow(1.0 + r * r / u, -shape);
+    }, L);
+  }
+};
+
+// 2D Cauchy kernel: the 2Dt kernel with shape p = 0.5, constructed from
+// (dispersal_range, L) like every other kernel.
+class cauchy_kernel : public fat_tailed_kernel {
+public:
+  cauchy_kernel(double dispersal_range, size_t L) :
+    fat_tailed_kernel(dispersal_range, L, 0.5) {}
+};
+
+// Nearest neighbour kernels ignore dispersal_range: the parent is one of the
+// NUM_NEIGHBOURS adjacent cells, picked from the low bits of one draw.
+template <size_t NUM_NEIGHBOURS>
+class neighbour_kernel {
+  static_assert(NUM_NEIGHBOURS == 4 || NUM_NEIGHBOURS == 8,
+                "use 4 (von Neumann) or 8 (Moore) neighbours");
+public:
+  neighbour_kernel(double, size_t L) : L_(L) {
+    const int dx[8] = {-1, 1, 0, 0, -1, -1, 1, 1};
+    const int dy[8] = {0, 0, -1, 1, -1, 1, -1, 1};
+    const int iL = static_cast<int>(std::max<size_t>(L, 1));
+    for (size_t i = 0; i < NUM_NEIGHBOURS; ++i) {
+      dx_[i] = static_cast<uint32_t>((dx[i] + iL) % iL);
+      dy_[i] = static_cast<uint32_t>((dy[i] + iL) % iL);
+    }
+  }
+
+  size_t operator()(size_t source_x, size_t source_y, rnd_t& rndgen) const {
+    auto r = rndgen.random_bits() & (NUM_NEIGHBOURS - 1);
+    size_t x = source_x + dx_[r];
+    size_t y = source_y + dy_[r];
+    x -= L_ & (0 - static_cast<size_t>(x >= L_));
+    y -= L_ & (0 - static_cast<size_t>(y >= L_));
+    return x * L_ + y;
+  }
+
+  size_t reach() const noexcept {
+    return 1;
+  }
+
+  // as radial_dispersal::fill_row
+  void fill_row(size_t source_x, size_t y0, size_t n, uint32_t* target, rnd_t& rndgen) const {
+    for (size_t i = 0; i < n; ++i) {
+      target[i] = rndgen.random_bits() & (NUM_NEIGHBOURS - 1);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      size_t x = source_x + dx_[target[i]];
+      size_t y = y0 + i + dy_[target[i]];
+      x -= L_ & (0 - static_cast<size_t>(x >= L_));
+      y -= L_ & (0 - static_cast<size_t>(y >= L_));
+      target[i] = static_cast<uint32_t>(x * L_ + y);
+    }
+  }
+
+private:
+  size_t L_;
+  std::array<uint32_t, NUM_NEIGHBOURS> dx_;
+  std::array<uint32_t, NUM_NEIGHBOURS> dy_;
+};
+
+using von_neumann_kernel = neighbour_kernel<4>;
+using moore_kernel = neighbour_kernel<8>;
+
+#endif /* dispersal_h */
@@ -0,0 +1,217 @@
+//
+//  dynamic_metacommunity.h
+//  neutralizer_backbone
+//
+//  Metacommunity with its own neutral drift: a non-spatial Moran process
+//  that keeps pace with the local community, optionally in a background
+//  thread.
+//
+
+#ifndef dynamic_metacommunity_h
+#define dynamic_metacommunity_h
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include "rand_t.h"
+#include "ewens.h"
+#include "fenwick_tree.h"
+
+// Starts from an Ewens partition of Jm individuals. Every step one random
+// individual dies and is replaced by a new species with probability
+// nu = theta / (theta + Jm - 1), otherwise by the offspring of one of the
+// other Jm - 1 individuals. This keeps the Ewens partition with the same
+// theta as its stationary distribution. Abundances are kept in a Fenwick
+// tree, so both picks are O(log S).
+//
+// The local community reports its clock (simulation_t::t) with
+// set_clock(); the metacommunity is kept at rate * clock steps.
+//
+// By default there is no thread: set_clock() does the steps itself and
+// migrants are drawn from the current state, so a run depends on its seed
+// only. With background = true the steps run in a thread and migrants are
+// drawn from the latest published snapshot; the owner thread takes a new
+// snapshot only after an atomic flag says one is ready, so update() never
+// waits for the metacommunity, but which snapshot a migrant sees depends
+// on timing and runs are not reproducible.
+class dynamic_metacommunity {
+public:
+  // species are identified by ids that are never reused
+  struct snapshot {
+    fenwick_tree tree;              // abundance per slot
+    std::vector<size_t> counts;     // the same, for reading
+    std::vector<uint64_t> ids;      // species id per slot
+    size_t steps = 0;               // metacommunity steps so far
+  };
+
+  struct draw {
+    uint64_t id;
+    size_t count;
+  };
+
+  dynamic_metacommunity(size_t Jm, double theta, double rate,
+                        rnd_t rndgen, bool background = false) :
+    Jm_(std::max<size_t>(Jm, 1)),
+    rate_(rate),
+    nu_threshold_(rnd_t::bernouilli_threshold(Jm_ > 1 ? theta / (theta + Jm_ - 1) : 1.0)),
+    rndgen_(rndgen) {
+    counts_ = ewens_partition(Jm_, theta, rndgen_);
+    for (size_t i = 0; i < counts_.size(); ++i) ids_.push_back(next_id_++);
+    tree_.assign(counts_);
+    if (background) {
+      publish();
+      current_ = latest_;
+      fresh_ = false;
+      worker_ = std::thread([this] { run(); });
+    }
+  }
+
+  ~dynamic_metacommunity() {
+    stop_ = true;
+    if (worker_.joinable()) worker_.join();
+  }
+
+  dynamic_metacommunity(const dynamic_metacommunity&) = delete;
+  dynamic_metacommunity& operator=(const dynamic_metacommunity&) = delete;
+
+  // clock of the local community, in events
+  void set_clock(size_t t) {
+    if (worker_.joinable()) {
+      clock_.store(t, std::memory_order_relaxed);
+      return;
+    }
+    const size_t target = static_cast<size_t>(rate_ * t);
+    while (steps_ < target) step();
+  }
+
+  // species of a random individual, of the latest snapshot with the
+  // background thread; owner thread only
+  draw sample(rnd_t& rndgen) {
+    if (!worker_.joinable()) {
+      const size_t slot = tree_.find(rndgen.random_number(Jm_));
+      return draw{ids_[slot], counts_[slot]};
+    }
+    const auto& s = current();
+    const size_t slot = s.tree.find(rndgen.random_number(Jm_));
+    return draw{s.ids[slot], s.counts[slot]};
+  }
+
+  // abundances of the species present; owner thread only
+  std::vector<size_t> abundances() {
+    std::vector<size_t> out;
+    for (auto i : worker_.joinable() ? current().counts : counts_) {
+      if (i > 0) out.push_back(i);
+    }
+    return out;
+  }
+
+  size_t steps() {
+    return worker_.joinable() ? current().steps : steps_;
+  }
+
+private:
+  const size_t Jm_;
+  const double rate_;              // metacommunity steps per local event
+  const uint64_t nu_threshold_;
+
+  // state of the process, touched only by the thread that advances it
+  rnd_t rndgen_;
+  std::vector<size_t> counts_;
+  std::vector<uint64_t> ids_;
+  std::vector<size_t> free_slots_;
+  fenwick_tree tree_;
+  uint64_t next_id_ = 0;
+  size_t steps_ = 0;
+
+  // hand-off
+  std::atomic<size_t> clock_{0};
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> fresh_{false};
+  std::mutex latest_mutex_;
+  std::shared_ptr<const snapshot> latest_;
+  std::shared_ptr<const snapshot> current_; // owner thread's copy
+  std::thread worker_;
+
+  static constexpr size_t min_steps_per_snapshot = 4096;
+
+  const snapshot& current() {
+    if (fresh_.exchange(false, std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(latest_mutex_);
+      current_ = latest_;
+    }
+    return *current_;
+  }
+
+  void step() {
+    const size_t dead = tree_.find(rndgen_.random_number(Jm_));
+    remove_one(dead);
+
+    if (Jm_ == 1 || rndgen_.below_threshold(nu_threshold_)) {
+      size_t slot;
+      if (free_slots_.empty()) {
+        slot = counts_.size();
+        counts_.push_back(0);
+        ids_.push_back(0);
+        tree_.push_back(0);
+      } else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+      }
+      ids_[slot] = next_id_++;
+      counts_[slot] = 1;
+      tree_.add(slot, 1);
+    } else {
+      const size_t parent = tree_.find(rndgen_.random_number(Jm_ - 1));
+      counts_[parent]++;
+      tree_.add(parent, 1);
+    }
+    steps_++;
+  }
+
+  void remove_one(size_t slot) {
+    counts_[slot]--;
+    tree_.add(slot, -1);
+    if (counts_[slot] == 0) free_slots_.push_back(slot);
+  }
+
+  // background thread: runs up to rate * clock steps, publishing a
+  // snapshot every so many steps; snapshots cost O(S), so they are spaced
+  // at least S steps apart
+  void catch_up() {
+    const size_t target = static_cast<size_t>(rate_ * clock_.load(std::memory_order_relaxed));
+    while (steps_ < target && !stop_) {
+      const size_t chunk = std::min(target - steps_,
+                                    std::max(min_steps_per_snapshot, counts_.size()));
+      for (size_t i = 0; i < chunk; ++i) step();
+      publish();
+    }
+  }
+
+  void publish() {
+    auto s = std::make_shared<snapshot>();
+    s->tree = tree_;
+    s->counts = counts_;
+    s->ids = ids_;
+    s->steps = steps_;
+    {
+      std::lock_guard<std::mutex> lock(latest_mutex_);
+      latest_ = std::move(s);
+    }
+    fresh_.store(true, std::memory_order_release);
+  }
+
+  void run() {
+    while (!stop_) {
+      const size_t before = steps_;
+      catch_up();
+      if (steps_ == before) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+};
+
+#endif /* dynamic_metacommunity_h */
@@ -0,0 +1,50 @@
+//
+//  ewens.h
+//  neutralizer_backbone
+//
+//  Sequential stick breaking for the Ewens partition, the species
+//  abundance distribution of a neutral metacommunity.
+//
+
+#ifndef ewens_h
+#define ewens_h
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include "rand_t.h"
+
+// In order of appearance, each species takes a Beta(1, theta) share of
+// what the species before it left over (the GEM distribution).
+inline double ewens_share(double theta, rnd_t& rndgen) {
+  const double u = 1.0 - rndgen.uniform_double(); // (0, 1]
+  return 1.0 - std::pow(u, 1.0 / theta);
+}
+
+// size of the next species when remaining individuals are left:
+// 1 + Binomial(remaining - 1, share)
+inline size_t ewens_next_size(size_t remaining, double theta, rnd_t& rndgen) {
+  const double w = ewens_share(theta, rndgen);
+  size_t size = 1;
+  if (remaining > 1 && w > 0.0) {
+    std::binomial_distribution<size_t> binom(remaining - 1, std::min(w, 1.0));
+    size += binom(rndgen.rndgen);
+  }
+  return size;
+}
+
+// Ewens partition of Jm individuals, i.e. the Hoppe urn run for Jm steps,
+// in O(S) draws instead of one urn step per individual
+inline std::vector<size_t> ewens_partition(size_t Jm, double theta, rnd_t& rndgen) {
+  std::vector<size_t> abund;
+  size_t remaining = std::max<size_t>(Jm, 1);
+  while (remaining > 0) {
+    auto size = ewens_next_size(remaining, theta, rndgen);
+    abund.push_back(size);
+    remaining -= size;
+  }
+  return abund;
+}
+
+#endif /* ewens_h */
@@ -0,0 +1,95 @@
+//
+//  fenwick_tree.h
+//  neutralizer_backbone
+//
+//  Binary indexed tree over non-negative counts: point updates, prefix
+//  sums and "which slot holds individual r" in O(log n).
+//
+
+#ifndef fenwick_tree_h
+#define fenwick_tree_h
+
+#include <vector>
+#include <cstddef>
+
+class fenwick_tree {
+public:
+  fenwick_tree() {}
+
+  explicit fenwick_tree(const std::vector<size_t>& counts) {
+    assign(counts);
+  }
+
+  // O(n) construction
+  void assign(const std::vector<size_t>& counts) {
+    tree_.assign(counts.size() + 1, 0);
+    total_ = 0;
+    for (size_t i = 1; i <= counts.size(); ++i) {
+      tree_[i] += counts[i - 1];
+      total_ += counts[i - 1];
+      size_t parent = i + (i & (0 - i));
+      if (parent <= counts.size()) tree_[parent] += tree_[i];
+    }
+    update_top_bit();
+  }
+
+  size_t size() const noexcept {
+    return tree_.empty() ? 0 : tree_.size() - 1;
+  }
+
+  size_t total() const noexcept {
+    return total_;
+  }
+
+  // appends a slot holding count
+  void push_back(size_t count) {
+    if (tree_.empty()) tree_.push_back(0);
+    const size_t i = tree_.size();
+    // node i covers (i - lowbit(i), i]: the new count plus the nodes below
+    size_t sum = count;
+    const size_t low = i - (i & (0 - i));
+    for (size_t j = i - 1; j > low; j -= j & (0 - j)) sum += tree_[j];
+    tree_.push_back(sum);
+    total_ += count;
+    update_top_bit();
+  }
+
+  // count of slot i += delta (delta may be negative, the count may not)
+  void add(size_t i, long delta) {
+    total_ += delta;
+    for (++i; i < tree_.size(); i += i & (0 - i)) tree_[i] += delta;
+  }
+
+  // sum of the counts of slots [0, i)
+  size_t prefix_sum(size_t i) const {
+    size_t sum = 0;
+    for (; i > 0; i -= i & (0 - i)) sum += tree_[i];
+    return sum;
+  }
+
+  // slot holding individual r, i.e. the smallest i with
+  // prefix_sum(i + 1) > r; requires r < total()
+  size_t find(size_t r) const {
+    size_t pos = 0;
+    for (size_t step = top_bit_; step > 0; step >>= 1) {
+      if (pos + step < tree_.size() && tree_[pos + step] <= r) {
+        pos += step;
+        r -= tree_[pos];
+      }
+    }
+    return pos;
+  }
+
+private:
+  std::vector<size_t> tree_;    // 1-based, tree_[0] unused
+  size_t total_ = 0;
+  size_t top_bit_ = 0;          // largest power of two <= size()
+
+  void update_top_bit() {
+    top_bit_ = 1;
+    while (top_bit_ * 2 <= size()) top_bit_ *= 2;
+    if (size() == 0) top_bit_ = 0;
+  }
+};
+
+#endif /* fenwick_tree_h */
@@ -0,0 +1,163 @@
+//
+//  fft.h
+//  neutralizer_backbone
+//
+//  Complex FFT of any length (radix 2, Bluestein for the other lengths)
+//  and a 2D transform of a square row-major grid.
+//
+
+#ifndef fft_h
+#define fft_h
+
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <cstddef>
+
+class fft_plan {
+public:
+  using cplx = std::complex<double>;
+
+  explicit fft_plan(size_t n) : n_(n) {
+    if (is_power_of_two(n)) {
+      make_radix2(n);
+      return;
+    }
+    // Bluestein: a length n DFT is a convolution with the chirp
+    // w_k = exp(-i pi k^2 / n), done as a power-of-two cyclic convolution
+    m_ = 1;
+    while (m_ < 2 * n - 1) m_ *= 2;
+    make_radix2(m_);
+    chirp_.resize(n);
+    const double pi = std::acos(-1.0);
+    for (size_t k = 0; k < n; ++k) {
+      // k^2 mod 2n keeps the angle small and exact for large k
+      const double angle = pi * static_cast<double>((k * k) % (2 * n)) / n;
+      chirp_[k] = cplx(std::cos(angle), -std::sin(angle));
+    }
+    chirp_fft_.assign(m_, cplx(0, 0));
+    chirp_fft_[0] = std::conj(chirp_[0]);
+    for (size_t k = 1; k < n; ++k) {
+      chirp_fft_[k] = chirp_fft_[m_ - k] = std::conj(chirp_[k]);
+    }
+    radix2(chirp_fft_.data(), false);
+    // fold the 1 / m of the inner inverse transform into the kernel
+    for (auto& i : chirp_fft_) i /= static_cast<double>(m_);
+    work_.resize(m_);
+  }
+
+  size_t size() const noexcept {
+    return n_;
+  }
+
+  // unnormalised: inverse(forward(x)) = n x
+  void forward(cplx* data) {
+    transform(data, false);
+  }
+
+  void inverse(cplx* data) {
+    transform(data, true);
+  }
+
+  // 2D transform of an n x n row-major grid
+  void forward_2d(std::vector<cplx>& grid) {
+    transform_2d(grid, false);
+  }
+
+  void inverse_2d(std::vector<cplx>& grid) {
+    transform_2d(grid, true);
+  }
+
+private:
+  size_t n_;
+  size_t m_ = 0;                      // Bluestein length, 0 for radix 2
+  std::vector<cplx> twiddle_;
+  std::vector<cplx> inverse_twiddle_;
+  std::vector<size_t> bit_reverse_;
+  std::vector<cplx> chirp_;
+  std::vector<cplx> chirp_fft_;
+  std::vector<cplx> work_;
+  std::vector<cplx> column_;
+
+  static bool is_power_of_two(size_t n) {
+    return n > 0 && (n & (n - 1)) == 0;
+  }
+
+  void make_radix2(size_t n) {
+    const double pi = std::acos(-1.0);
+    twiddle_.resize(n / 2);
+    inverse_twiddle_.resize(n / 2);
+    for (size_t k = 0; k < n / 2; ++k) {
+      twiddle_[k] = cplx(std::cos(2 * pi * k / n), -std::sin(2 * pi * k / n));
+      inverse_twiddle_[k] = std::conj(twiddle_[k]);
+    }
+    auto& rev = bit_reverse_;
+    rev.assign(n, 0);
+    size_t bits = 0;
+    while ((size_t(1) << bits) < n) bits++;
+    for (size_t i = 0; i < n; ++i) {
+      size_t r = 0;
+      for (size_t b = 0; b < bits; ++b) {
+        if (i & (size_t(1) << b)) r |= size_t(1) << (bits - 1 - b);
+      }
+      rev[i] = r;
+    }
+  }
+
+  // in place, length twiddle_.size() * 2
+  void radix2(cplx* a, bool inverse) const {
+    const size_t n = bit_reverse_.size();
+    for (size_t i = 0; i < n; ++i) {
+      if (i < bit_reverse_[i]) std::swap(a[i], a[bit_reverse_[i]]);
+    }
+    const cplx* twiddle = inverse ? inverse_twiddle_.data() : twiddle_.data();
+    for (size_t len = 2; len <= n; len *= 2) {
+      const size_t half = len / 2;
+      const size_t step = n / len;
+      for (size_t i = 0; i < n; i += len) {
+        for (size_t k = 0; k < half; ++k) {
+          const cplx w = twiddle[k * step];
+          const cplx u = a[i + k];
+          // written out: std::complex multiplication checks for NaN
+          const cplx b = a[i + k + half];
+          const cplx v(b.real() * w.real() - b.imag() * w.imag(),
+                       b.real() * w.imag() + b.imag() * w.real());
+          a[i + k] = u + v;
+          a[i + k + half] = u - v;
+        }
+      }
+    }
+  }
+
+  void transform(cplx* data, bool inverse) {
+    if (m_ == 0) {
+      radix2(data, inverse);
+      return;
+    }
+    // the inverse DFT is the conjugate of the forward DFT of the conjugate
+    for (size_t k = 0; k < n_; ++k) {
+      const cplx x = inverse ? std::conj(data[k]) : data[k];
+      work_[k] = x * chirp_[k];
+    }
+    std::fill(work_.begin() + n_, work_.end(), cplx(0, 0));
+    radix2(work_.data(), false);
+    for (size_t k = 0; k < m_; ++k) work_[k] *= chirp_fft_[k];
+    radix2(work_.data(), true);
+    for (size_t k = 0; k < n_; ++k) {
+      const cplx y = work_[k] * chirp_[k];
+      data[k] = inverse ? std::conj(y) : y;
+    }
+  }
+
+  void transform_2d(std::vector<cplx>& grid, bool inverse) {
+    for (size_t x = 0; x < n_; ++x) transform(grid.data() + x * n_, inverse);
+    column_.resize(n_);
+    for (size_t y = 0; y < n_; ++y) {
+      for (size_t x = 0; x < n_; ++x) column_[x] = grid[x * n_ + y];
+      transform(column_.data(), inverse);
+      for (size_t x = 0; x < n_; ++x) grid[x * n_ + y] = column_[x];
+    }
+  }
+};
+
+#endif /* fft_h */
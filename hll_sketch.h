@@ -0,0 +1,232 @@
+//
+//  hll_sketch.h
+//  neutralizer_backbone
+//
+//  Approximate species richness per block with HyperLogLog sketches, for
+//  worlds where exact distinct counting is too slow or too large.
+//
+
+#ifndef hll_sketch_h
+#define hll_sketch_h
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "cell.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// HyperLogLog (Flajolet et al. 2007) with 2^precision one-byte registers,
+// 64-bit hashes and linear counting for small sets. Sketches are plain
+// runs of registers so that many of them can share one flat array; the
+// union of two sets is the register-wise max of their sketches.
+struct hll_sketch {
+  static uint64_t hash(uint64_t x) {
+    // splitmix64 finaliser
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  static void insert(uint8_t* registers, size_t precision, uint64_t h) {
+    const size_t index = static_cast<size_t>(h >> (64 - precision));
+    const uint64_t rest = h << precision;
+    const uint8_t rank = static_cast<uint8_t>(
+          rest == 0 ? 64 - precision + 1 : leading_zeros(rest) + 1);
+    if (rank > registers[index]) registers[index] = rank;
+  }
+
+  // dst = union of dst and src
+  static void merge(uint8_t* dst, const uint8_t* src, size_t num_registers) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= num_registers; i += 16) {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_max_epu8(a, b));
+    }
+#endif
+    for (; i < num_registers; ++i) dst[i] = std::max(dst[i], src[i]);
+  }
+
+  static double estimate(const uint8_t* registers, size_t precision) {
+    const size_t m = size_t(1) << precision;
+    static const std::vector<double> inverse_powers = [] {
+      std::vector<double> v(256);
+      for (size_t i = 0; i < v.size(); ++i) v[i] = std::ldexp(1.0, -static_cast<int>(i));
+      return v;
+    }();
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < m; ++i) {
+      sum += inverse_powers[registers[i]];
+      zeros += registers[i] == 0;
+    }
+    const double alpha = m >= 128 ? 0.7213 / (1.0 + 1.079 / m)
+                                  : (m == 64 ? 0.709 : (m == 32 ? 0.697 : 0.673));
+    const double raw = alpha * m * m / sum;
+    if (raw <= 2.5 * m && zeros > 0) {
+      return m * std::log(static_cast<double>(m) / zeros);
+    }
+    return raw;
+  }
+
+  // relative standard error of an estimate
+  static double relative_error(size_t precision) {
+    return 1.04 / std::sqrt(static_cast<double>(size_t(1) << precision));
+  }
+
+private:
+  static size_t leading_zeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_clzll(x));
+#else
+    size_t n = 0;
+    for (uint64_t bit = uint64_t(1) << 63; !(x & bit); bit >>= 1) n++;
+    return n;
+#endif
+  }
+};
+
+struct approx_grain {
+  size_t side = 0;              // blocks are side x side cells
+  size_t num_blocks = 0;
+  double mean_richness = 0.0;   // mean HyperLogLog estimate per block
+  double std_error = 0.0;       // standard error of mean_richness
+};
+
+// Like block_aggregation, but with a sketch per block: one pass over the
+// world fills the sketches of the base blocks (side base_side), and every
+// larger grain merges the four sketches below it. Memory is one level of
+// sketches, (L / base_side)^2 * 2^precision bytes. With base_side = 0 the
+// base side is the smallest power of two that keeps this at most one byte
+// per cells_per_byte cells, 1 / 64 of the world itself; below that grain
+// block_aggregation is cheaper anyway.
+//
+// The standard error of a grain is that of the mean over its blocks: the
+// spread of the block estimates over the square root of their number,
+// combined with the error of a single sketch. All blocks hash with the
+// same function, so their sketch errors are correlated (two common
+// species that collide in one block collide in all) and do not average
+// out over the blocks.
+class hll_block_aggregation {
+public:
+  static constexpr size_t cells_per_byte = 16;
+
+  hll_block_aggregation(const std::vector<species_index>& world, size_t L,
+                        size_t base_side = 0, size_t precision = 10,
+                        size_t num_threads = 1) :
+    world_(world), L_(L),
+    precision_(std::min<size_t>(std::max<size_t>(precision, 4), 18)),
+    num_threads_(std::max<size_t>(1, num_threads)) {
+    base_side_ = base_side > 0 ? base_side : budget_base_side(L, precision_);
+  }
+
+  // smallest power of two b, at most L, with 2^precision <= b^2 / cells_per_byte
+  static size_t budget_base_side(size_t L, size_t precision) {
+    size_t side = 1;
+    while (side * side < (cells_per_byte << precision) && 2 * side <= L) side *= 2;
+    return side;
+  }
+
+  size_t base_side() const noexcept {
+    return base_side_;
+  }
+
+  // grains base_side, 2 base_side, ... up to L
+  std::vector<approx_grain> run() {
+    std::vector<approx_grain> out;
+    const size_t m = size_t(1) << precision_;
+    size_t per_side = L_ / base_side_;
+    if (per_side == 0) return out;
+
+    std::vector<uint8_t> level(per_side * per_side * m, 0);
+    parallel_for(per_side * per_side, [&](size_t b) {
+      fill_base_block(b / per_side, b % per_side, level.data() + b * m);
+    });
+    out.push_back(summarise(level, per_side, base_side_));
+
+    for (size_t side = 2 * base_side_; side <= L_; side *= 2) {
+      const size_t next_per_side = L_ / side;
+      std::vector<uint8_t> next(next_per_side * next_per_side * m, 0);
+      parallel_for(next_per_side * next_per_side, [&](size_t b) {
+        const size_t bx = b / next_per_side;
+        const size_t by = b % next_per_side;
+        uint8_t* dst = next.data() + b * m;
+        for (size_t dx = 0; dx < 2; ++dx) {
+          for (size_t dy = 0; dy < 2; ++dy) {
+            const size_t child = (2 * bx + dx) * per_side + (2 * by + dy);
+            hll_sketch::merge(dst, level.data() + child * m, m);
+          }
+        }
+      });
+      level.swap(next);
+      per_side = next_per_side;
+      out.push_back(summarise(level, per_side, side));
+    }
+    return out;
+  }
+
+private:
+  const std::vector<species_index>& world_;
+  size_t L_;
+  size_t base_side_;
+  size_t precision_;
+  size_t num_threads_;
+
+  void fill_base_block(size_t bx, size_t by, uint8_t* registers) const {
+    for (size_t x = bx * base_side_; x < (bx + 1) * base_side_; ++x) {
+      const species_index* row = world_.data() + x * L_ + by * base_side_;
+      species_index last = row[0];
+      hll_sketch::insert(registers, precision_, hll_sketch::hash(last));
+      for (size_t y = 1; y < base_side_; ++y) {
+        // neighbours are often conspecific; skip the repeated hash
+        if (row[y] == last) continue;
+        last = row[y];
+        hll_sketch::insert(registers, precision_, hll_sketch::hash(last));
+      }
+    }
+  }
+
+  approx_grain summarise(const std::vector<uint8_t>& level, size_t per_side, size_t side) const {
+    const size_t m = size_t(1) << precision_;
+    const size_t n = per_side * per_side;
+    std::vector<double> estimates(n);
+    parallel_for(n, [&](size_t b) {
+      estimates[b] = hll_sketch::estimate(level.data() + b * m, precision_);
+    });
+    approx_grain g;
+    g.side = side;
+    g.num_blocks = n;
+    for (auto e : estimates) g.mean_richness += e;
+    g.mean_richness /= n;
+    double sampling_var = 0.0;
+    if (n > 1) {
+      for (auto e : estimates) sampling_var += (e - g.mean_richness) * (e - g.mean_richness);
+      sampling_var /= static_cast<double>(n - 1) * n;
+    }
+    const double sketch_error = hll_sketch::relative_error(precision_) * g.mean_richness;
+    g.std_error = std::sqrt(sampling_var + sketch_error * sketch_error);
+    return g;
+  }
+
+  // f(i) for i in [0, n), in contiguous ranges over the threads
+  template <typename F>
+  void parallel_for(size_t n, F f) const {
+    const size_t num_threads = std::min(num_threads_, std::max<size_t>(1, n));
+    auto work = [&](size_t t) {
+      for (size_t i = t * n / num_threads; i < (t + 1) * n / num_threads; ++i) f(i);
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; ++t) threads.emplace_back(work, t);
+    work(0);
+    for (auto& i : threads) i.join();
+  }
+};
+
+#endif /* hll_sketch_h */
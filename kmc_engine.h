@@ -0,0 +1,260 @@
+//
+//  kmc_engine.h
+//  neutralizer_backbone
+//
+//  Rejection-free update of a simulation_t: events that cannot change the
+//  world are skipped in bulk instead of drawn one by one.
+//
+
+#ifndef kmc_engine_h
+#define kmc_engine_h
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include "cell.h"
+#include "rand_t.h"
+
+template <typename DISPERSAL> class simulation_t;
+
+struct kmc_run_stats {
+  size_t events = 0;          // Moran events, skipped ones included
+  size_t drawn = 0;           // events that were actually drawn
+  double seconds = 0.0;
+  size_t active_cells = 0;    // at the end of the run
+
+  double events_per_second() const {
+    return seconds > 0.0 ? events / seconds : 0.0;
+  }
+};
+
+// A local reproduction copies a cell within the reach of the dispersal
+// kernel onto the dying cell. A cell is active if some cell within that
+// reach (a square of side 2 reach + 1) holds another species; local
+// reproduction on an inactive cell never changes anything. Every Moran
+// event is thus either a candidate, which is a speciation or immigration
+// anywhere or a local reproduction on an active cell, or certainly a
+// no-op. A candidate has probability
+//   p = (1 - prob_same) + prob_same * A / N
+// for A active cells, so the no-ops before the next candidate are a
+// geometric number with parameter p: they only advance t. The candidate
+// itself is drawn as in update(), restricted to active cells when it is a
+// local reproduction, so the process is the Moran process of update(),
+// event for event in distribution. Near monodominance A is small and most
+// events are skipped. While p is above dense_limit there is little to
+// skip; the engine then runs update() a generation at a time, without
+// counts, and estimates A from a sample of cells in between, to see if
+// recounting is worth it.
+//
+// For every cell the engine counts the cells of another species within
+// reach; a change of one cell updates the counts of the cells around it,
+// which is why the reach has to be small (see is_available()). Active
+// cells are kept in a list for O(1) sampling. The engine draws from the
+// serial stream of the simulation, and rebuilds its counts when the world
+// was changed by something else since the last run().
+template <typename DISPERSAL>
+class kmc_engine {
+public:
+  // largest square (side 2 reach + 1) that is scanned per change
+  static constexpr size_t max_window = 17;
+  // above this candidate probability events are drawn one by one
+  static constexpr double dense_limit = 0.5;
+  // cells looked at to estimate the number of active cells
+  static constexpr size_t num_probes = 256;
+
+  explicit kmc_engine(simulation_t<DISPERSAL>& sim) :
+    sim_(sim),
+    L_(sim.L),
+    reach_(std::max<size_t>(1, sim.dispersal_.reach())) {}
+
+  // false if the kernel reaches too far, or wraps around the world;
+  // run() then falls back to update()
+  bool is_available() const noexcept {
+    const size_t window = 2 * reach_ + 1;
+    return window <= max_window && window <= L_;
+  }
+
+  size_t num_active() const noexcept {
+    return active_.size();
+  }
+
+  // runs num_events Moran events; the last skip is cut off at the end, as
+  // the number of no-ops until the next candidate is memoryless
+  kmc_run_stats run(size_t num_events) {
+    kmc_run_stats stats;
+    auto start = std::chrono::steady_clock::now();
+    const size_t t_end = sim_.t + num_events;
+
+    if (!is_available()) {
+      while (sim_.t < t_end) sim_.update();
+      stats.drawn = num_events;
+    } else {
+      if (sim_.t != t_synced_) synced_ = false;
+      auto& rndgen = sim_.rndgen_;
+      const size_t cells = L_ * L_;
+      const double N = static_cast<double>(cells);
+      const double p_other = 1.0 - sim_.prob_same;
+      while (sim_.t < t_end) {
+        double p;
+        if (synced_) {
+          p = p_other + sim_.prob_same * active_.size() / N;
+        } else {
+          // a rebuild is only worth it if events are going to be skipped
+          p = p_other + sim_.prob_same * sampled_active_fraction(rndgen);
+          if (p <= dense_limit) {
+            rebuild();
+            p = p_other + sim_.prob_same * active_.size() / N;
+          }
+        }
+        if (p > dense_limit) {
+          // little to skip: a generation of plain update(), without
+          // keeping the counts, which are rebuilt afterwards
+          const size_t n = std::min(t_end - sim_.t, cells);
+          for (size_t i = 0; i < n; ++i) sim_.update();
+          stats.drawn += n;
+          synced_ = false;
+          continue;
+        }
+        if (p <= 0.0) {
+          sim_.t = t_end;
+          break;
+        }
+        const size_t skip = geometric(p, rndgen);
+        if (skip >= t_end - sim_.t) {
+          sim_.t = t_end;
+          break;
+        }
+        sim_.t += skip;
+        stats.drawn++;
+
+        size_t pos;
+        species_index new_species;
+        if (rndgen.uniform_double() * p < p_other) {
+          pos = rndgen.random_pos();
+          new_species = rndgen.below_threshold(sim_.rel_prob_spec_threshold_)
+                        ? sim_.new_species()
+                        : sim_.get_species_from_meta_community();
+        } else {
+          pos = active_[rndgen.random_number(active_.size())];
+          new_species = sim_.world[sim_.dispersal_(pos / L_, pos % L_, rndgen)];
+        }
+        change(pos, new_species);
+        sim_.t++;
+      }
+      t_synced_ = sim_.t;
+    }
+
+    stats.events = num_events;
+    stats.active_cells = active_.size();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+  }
+
+private:
+  static constexpr uint32_t not_active = ~uint32_t(0);
+
+  simulation_t<DISPERSAL>& sim_;
+  size_t L_;
+  size_t reach_;
+  bool synced_ = false;
+  size_t t_synced_ = 0;
+
+  // per cell: cells of another species within reach
+  std::vector<uint16_t> num_different_;
+  std::vector<uint32_t> active_;
+  std::vector<uint32_t> slot_;       // index in active_, or not_active
+
+  // failures before the first success, p in (0, 1]
+  static size_t geometric(double p, rnd_t& rndgen) {
+    if (p >= 1.0) return 0;
+    const double u = 1.0 - rndgen.uniform_double();   // (0, 1]
+    const double k = std::floor(std::log(u) / std::log1p(-p));
+    return k < 1e18 ? static_cast<size_t>(k) : static_cast<size_t>(1e18);
+  }
+
+  // f(i) for every cell i within reach of pos, pos itself excluded
+  template <typename F>
+  void for_each_neighbour(size_t pos, F f) const {
+    // x + L - reach + k for k = 0 .. 2 reach, reduced modulo L
+    const size_t x0 = pos / L_ + L_ - reach_;
+    const size_t y0 = pos % L_ + L_ - reach_;
+    for (size_t kx = 0; kx <= 2 * reach_; ++kx) {
+      size_t nx = x0 + kx;
+      if (nx >= L_) nx -= L_;
+      if (nx >= L_) nx -= L_;
+      const species_index* row = sim_.world.data() + nx * L_;
+      for (size_t ky = 0; ky <= 2 * reach_; ++ky) {
+        if (kx == reach_ && ky == reach_) continue;
+        size_t ny = y0 + ky;
+        if (ny >= L_) ny -= L_;
+        if (ny >= L_) ny -= L_;
+        f(nx * L_ + ny, row[ny]);
+      }
+    }
+  }
+
+  void set_active(size_t pos) {
+    const bool active = num_different_[pos] > 0;
+    if (active == (slot_[pos] != not_active)) return;
+    if (active) {
+      slot_[pos] = static_cast<uint32_t>(active_.size());
+      active_.push_back(static_cast<uint32_t>(pos));
+    } else {
+      const uint32_t last = active_.back();
+      active_[slot_[pos]] = last;
+      slot_[last] = slot_[pos];
+      active_.pop_back();
+      slot_[pos] = not_active;
+    }
+  }
+
+  double sampled_active_fraction(rnd_t& rndgen) const {
+    size_t active = 0;
+    for (size_t i = 0; i < num_probes; ++i) {
+      const size_t pos = rndgen.random_pos();
+      const species_index s = sim_.world[pos];
+      bool different = false;
+      for_each_neighbour(pos, [&](size_t, species_index other) { different |= other != s; });
+      active += different;
+    }
+    return static_cast<double>(active) / num_probes;
+  }
+
+  void rebuild() {
+    const size_t N = L_ * L_;
+    num_different_.assign(N, 0);
+    slot_.assign(N, not_active);
+    active_.clear();
+    for (size_t pos = 0; pos < N; ++pos) {
+      const species_index s = sim_.world[pos];
+      uint16_t n = 0;
+      for_each_neighbour(pos, [&](size_t, species_index other) { n += other != s; });
+      num_different_[pos] = n;
+      set_active(pos);
+    }
+    synced_ = true;
+  }
+
+  void change(size_t pos, species_index new_species) {
+    const species_index old_species = sim_.world[pos];
+    if (old_species == new_species) return;
+    sim_.set_cell(pos, new_species);
+    uint16_t n = 0;
+    for_each_neighbour(pos, [&](size_t i, species_index s) {
+      if (s == old_species) {
+        num_different_[i]++;
+        set_active(i);
+      } else if (s == new_species) {
+        num_different_[i]--;
+        set_active(i);
+      }
+      n += s != new_species;
+    });
+    num_different_[pos] = n;
+    set_active(pos);
+  }
+};
+
+#endif /* kmc_engine_h */
@@ -0,0 +1,95 @@
+//
+//  lazy_metacommunity.h
+//  neutralizer_backbone
+//
+//  Metacommunity that is never built in full: species are broken off the
+//  Ewens stick only when a migrant draw reaches them.
+//
+
+#ifndef lazy_metacommunity_h
+#define lazy_metacommunity_h
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "rand_t.h"
+#include "ewens.h"
+
+// Species are numbered in order of appearance (size-biased order) and
+// broken off as in ewens_partition. A migrant is a uniformly drawn
+// individual of the metacommunity: its species is found by binary search
+// over the sticks broken so far, and more sticks are broken only when the
+// draw falls beyond them. Expected memory is O(theta log n) after
+// n migrants.
+//
+// Jm = 0 is the infinite metacommunity, whose species abundance
+// distribution is Fisher's logseries with parameter theta. Species then
+// have a relative abundance instead of a count.
+class lazy_metacommunity {
+public:
+  lazy_metacommunity(size_t Jm, double theta, rnd_t rndgen) :
+    Jm_(Jm),
+    theta_(theta),
+    remaining_(Jm),
+    rndgen_(rndgen) {}
+
+  bool is_infinite() const noexcept {
+    return Jm_ == 0;
+  }
+
+  // number of species broken off so far
+  size_t size() const noexcept {
+    return is_infinite() ? remaining_mass_.size() : cum_count_.size();
+  }
+
+  // metacommunity abundance of species k (finite metacommunity only)
+  size_t abundance(size_t k) const {
+    return cum_count_[k] - (k > 0 ? cum_count_[k - 1] : 0);
+  }
+
+  // relative abundance of species k
+  double frequency(size_t k) const {
+    if (!is_infinite()) return static_cast<double>(abundance(k)) / Jm_;
+    return (k > 0 ? remaining_mass_[k - 1] : 1.0) - remaining_mass_[k];
+  }
+
+  // species of a random individual, in order of appearance
+  size_t sample(rnd_t& rndgen) {
+    if (is_infinite()) {
+      // v in (0, 1]; species k covers remaining_mass_[k] < v <= the mass
+      // left before it. Comparing remaining masses instead of cumulative
+      // ones keeps full precision in the far tail.
+      const double v = 1.0 - rndgen.uniform_double();
+      while (remaining_mass_.empty() || remaining_mass_.back() >= v) break_stick();
+      return static_cast<size_t>(std::upper_bound(remaining_mass_.begin(), remaining_mass_.end(),
+                                                  v, std::greater<double>()) - remaining_mass_.begin());
+    }
+    const size_t r = rndgen.random_number(Jm_);
+    while (cum_count_.empty() || cum_count_.back() <= r) break_stick();
+    return static_cast<size_t>(std::upper_bound(cum_count_.begin(), cum_count_.end(), r) -
+                               cum_count_.begin());
+  }
+
+private:
+  size_t Jm_;
+  double theta_;
+  size_t remaining_;                      // individuals not yet assigned
+  std::vector<size_t> cum_count_;         // finite: individuals in species 0..k
+  std::vector<double> remaining_mass_;    // infinite: mass left after species k
+  // own stream for breaking sticks, so the metacommunity does not depend
+  // on how the migrant draws are interleaved with other draws
+  rnd_t rndgen_;
+
+  void break_stick() {
+    if (is_infinite()) {
+      const double left = remaining_mass_.empty() ? 1.0 : remaining_mass_.back();
+      remaining_mass_.push_back(left * (1.0 - ewens_share(theta_, rndgen_)));
+      return;
+    }
+    const size_t size = ewens_next_size(remaining_, theta_, rndgen_);
+    remaining_ -= size;
+    cum_count_.push_back((cum_count_.empty() ? 0 : cum_count_.back()) + size);
+  }
+};
+
+#endif /* lazy_metacommunity_h */
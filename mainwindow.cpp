@@ -2,7 +2,9 @@
 #include "ui_mainwindow.h"
 
 #include "simulation.h"
+#include "meta_cache.h"
 #include <sstream>
+#include <QStandardPaths>
 
 #include <memory>
 
@@ -16,6 +18,13 @@ MainWindow::MainWindow(QWidget *parent)
   ui->box_spec_rate->setValue(1e-4);
   ui->box_migration_rate->setValue(1e-4);
   ui->box_size->setValue(100);
+  ui->box_seed->setValue(rnd_t::get_seed());
+
+  // built metacommunities are kept between sessions, keyed by Jm, theta
+  // and seed; with the same seed box value they are not rebuilt. The
+  // least recently used ones are removed above meta_cache::max_bytes()
+  meta_cache::set_directory(
+        QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString());
 
   ui->plot_species->addGraph();
   ui->plot_species->graph(0)->setPen(QPen(Qt::black));
@@ -112,18 +121,32 @@ void MainWindow::update_params() {
 
   Jm = ui->box_Jm->value();
   theta = ui->box_theta->value();
+  seed = static_cast<size_t>(ui->box_seed->value());
 
   bool init_mono_dom = ui->checkBox->checkState();
 
   set_resolution(row_size, row_size);
 
-  sim = std::make_unique<simulation>(row_size,
-                                     spec_rate,
-                                     migr_rate,
-                                     Jm,
-                                     disp_range,
-                                     theta,
-                                     init_mono_dom);
+  if (disp_range >= row_size) {
+      // dispersal spans the landscape: no grid needed, see well_mixed.h
+      sim = std::make_unique< community_model_of<well_mixed_simulation> >(row_size,
+                                                                          spec_rate,
+                                                                          migr_rate,
+                                                                          Jm,
+                                                                          disp_range,
+                                                                          theta,
+                                                                          init_mono_dom,
+                                                                          seed);
+    } else {
+      sim = std::make_unique< community_model_of<simulation> >(row_size,
+                                                               spec_rate,
+                                                               migr_rate,
+                                                               Jm,
+                                                               disp_range,
+                                                               theta,
+                                                               init_mono_dom,
+                                                               seed);
+    }
   auto dummy_max_y = 0;
   update_preston_plot(ui->plot_meta_comm,
                       meta_comm_bars,
@@ -138,7 +161,7 @@ void MainWindow::update_params() {
   ui->button_start->setText("Start");
   auto s = std::to_string(sim->num_species());
   ui->label_sp->setText(QString::fromStdString(s));
-  size_t current_t = static_cast<size_t>(1.0 * sim->t / (0.5 * sim->L * sim->L));
+  size_t current_t = static_cast<size_t>(1.0 * sim->time() / (0.5 * sim->side() * sim->side()));
   ui->label_time->setText(QString::fromStdString(std::to_string(current_t)));
   x_t.clear();
   y_t.clear();
@@ -213,14 +236,14 @@ void MainWindow::update_plots(double t,
 
   ui->plot_rankabund->graph(0)->clearData();
 
-  QVector<double> r_x(sim->rank_abund_curve.size());
-  QVector<double> r_y(sim->rank_abund_curve.size());
-  for (size_t i = 0; i < sim->rank_abund_curve.size(); ++i) {
+  QVector<double> r_x(sim->rank_abund_curve().size());
+  QVector<double> r_y(sim->rank_abund_curve().size());
+  for (size_t i = 0; i < sim->rank_abund_curve().size(); ++i) {
       r_x[i] = i;
-      r_y[i] = sim->rank_abund_curve[i];
+      r_y[i] = sim->rank_abund_curve()[i];
     }
-  if (sim->rank_abund_curve.size() > max_rank_abund_rank)
-    max_rank_abund_rank = sim->rank_abund_curve.size();
+  if (sim->rank_abund_curve().size() > max_rank_abund_rank)
+    max_rank_abund_rank = sim->rank_abund_curve().size();
   ui->plot_rankabund->graph(0)->setData(r_x, r_y);
 
   // ui->plot_rankabund->rescaleAxes();
@@ -239,12 +262,12 @@ void MainWindow::update_plots(double t,
   QVector<double> xval = QVector<double>::fromStdVector(sp_area_x);
   QVector<double> yval = QVector<double>::fromStdVector(sp_area_y);
   ui->plot_sp_area->graph(0)->setData(xval, yval);
-  ui->plot_sp_area->xAxis->setRange(1, sim->L * sim->L);
+  ui->plot_sp_area->xAxis->setRange(1, sim->side() * sim->side());
   ui->plot_sp_area->yAxis->setRange(1, *std::max_element(sp_area_y.begin(), sp_area_y.end()));
 
   auto s = std::to_string(sim->num_species());
   ui->label_sp->setText(QString::fromStdString(s));
-  size_t current_t = static_cast<size_t>(1.0 * sim->t / (0.5 * sim->L * sim->L));
+  size_t current_t = static_cast<size_t>(1.0 * sim->time() / (0.5 * sim->side() * sim->side()));
   ui->label_time->setText(QString::fromStdString(std::to_string(current_t)));
 }
 
@@ -259,24 +282,23 @@ void MainWindow::on_button_start_clicked()
   if (!is_running) {
     ui->button_start->setText("Pause");
     is_running = true;
-    int num_cells = 0.5 * sim->L * sim->L;
+    int num_cells = 0.5 * sim->side() * sim->side();
     std::vector< double > sp_area_x;
     std::vector< double > sp_area_y;
     while(true) {
             size_t update_step = 1 + static_cast<size_t>((1.0 * update_speed / 100) * num_cells);
 
-            sim->update();
+            // up to the next multiple of update_step
+            sim->run(update_step - sim->time() % update_step);
 
-            if (sim->t % update_step == 0) {
-                sim->update_stats();
+            sim->update_stats();
 
-                sim->update_species_area(sp_area_x, sp_area_y);
-                update_plots(1.0 * sim->t / num_cells,
-                             sp_area_x, sp_area_y);
-                update_display();
-                replot_graphs();
-                if(!is_running) break;
-              }
+            sim->update_species_area(sp_area_x, sp_area_y);
+            update_plots(1.0 * sim->time() / num_cells,
+                         sp_area_x, sp_area_y);
+            update_display();
+            replot_graphs();
+            if(!is_running) break;
       }
   } else {
     ui->button_start->setText("Continue");
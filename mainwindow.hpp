@@ -4,6 +4,8 @@
 #include <QMainWindow>
 #include "qcustomplot.h"
 #include "simulation.h"
+#include "well_mixed.h"
+#include "community_model.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -23,6 +25,7 @@ public:
   double disp_range;
   int Jm;
   double theta;
+  size_t seed;
 
   size_t update_speed;
 
@@ -48,7 +51,9 @@ private:
   Ui::MainWindow *ui;
   QImage image_;
 
-  std::unique_ptr<simulation> sim;
+  // a simulation, or a well_mixed_simulation when dispersal spans the
+  // landscape
+  std::unique_ptr<community_model> sim;
 
   QCPBars *meta_comm_bars;
   QCPBars *local_comm_bars;
@@ -0,0 +1,332 @@
+//
+//  meta_cache.h
+//  neutralizer_backbone
+//
+//  On-disk cache of built metacommunities, keyed by (Jm, theta, seed), so
+//  a regional pool that was built once loads straight from a file in
+//  later runs, GUI sessions and batch jobs.
+//
+
+#ifndef meta_cache_h
+#define meta_cache_h
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+#include "cell.h"
+#include "alias_table.h"
+#include "rand_t.h"
+#include "ewens.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define META_CACHE_MMAP 1
+#endif
+
+// A cache file is a header, one record per species and the alias table,
+// in the byte order of the machine that wrote it:
+//
+//   meta_cache_header
+//   meta_cache_species  x num_species
+//   alias_table::entry  x num_species
+//
+// Files are written to a temporary name and renamed into place, so
+// concurrent builders (e.g. replicates) never see half a file. Anything
+// that does not match the expected key or size is treated as a miss.
+//
+// Besides (Jm, theta, seed) the key holds a fingerprint of the code that
+// builds a metacommunity: a small partition built with rnd_t,
+// ewens_partition and alias_table, hashed. A change to any of these that
+// alters what a seed builds changes the fingerprint, so stale files are
+// missed instead of served; algorithm_revision covers changes that the
+// small partition does not show.
+//
+// The directory is kept below max_bytes (256 MiB by default): after every
+// store the least recently used files are removed. A hit counts as a use.
+struct meta_cache_header {
+  char magic[8];
+  uint64_t version;
+  uint64_t fingerprint;
+  uint64_t Jm;
+  double theta;
+  uint64_t seed;
+  uint64_t num_species;
+};
+
+struct meta_cache_species {
+  uint64_t count;
+  uint64_t id;
+  uint8_t color[3];
+  uint8_t padding[5];
+};
+
+class meta_cache {
+public:
+  // directory of the cache; empty (the default) disables caching
+  static void set_directory(const std::string& dir) {
+    directory_ref() = dir;
+  }
+
+  static const std::string& directory() {
+    return directory_ref();
+  }
+
+  static bool enabled() {
+    return !directory().empty();
+  }
+
+  // size limit of the directory; 0 lifts it
+  static void set_max_bytes(uint64_t max_bytes) {
+    max_bytes_ref() = max_bytes;
+  }
+
+  static uint64_t max_bytes() {
+    return max_bytes_ref();
+  }
+
+  static uint64_t fingerprint() {
+    static const uint64_t value = compute_fingerprint();
+    return value;
+  }
+
+  static std::string file_name(size_t Jm, double theta, size_t seed) {
+    uint64_t theta_bits;
+    std::memcpy(&theta_bits, &theta, sizeof(theta));
+    std::ostringstream name;
+    name << "meta_" << Jm << "_" << std::hex << theta_bits << std::dec << "_" << seed << ".bin";
+    return (std::filesystem::path(directory()) / name.str()).string();
+  }
+
+  // fills registry and sampler and returns true on a hit
+  static bool load(size_t Jm, double theta, size_t seed,
+                   std::vector<species>& registry,
+                   alias_table& sampler) {
+    if (!enabled()) return false;
+    mapped_file file(file_name(Jm, theta, seed));
+    if (file.size() < sizeof(meta_cache_header)) return false;
+
+    meta_cache_header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0 ||
+        header.version != version || header.fingerprint != fingerprint() ||
+        header.Jm != Jm ||
+        header.theta != theta || header.seed != seed) {
+      return false;
+    }
+    const size_t n = header.num_species;
+    const size_t expected = sizeof(meta_cache_header) +
+                            n * (sizeof(meta_cache_species) + sizeof(alias_table::entry));
+    if (file.size() != expected) return false;
+
+    const char* records = file.data() + sizeof(meta_cache_header);
+    registry.clear();
+    registry.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      meta_cache_species r;
+      std::memcpy(&r, records + i * sizeof(r), sizeof(r));
+      registry.push_back(species(r.count, r.id, {r.color[0], r.color[1], r.color[2]}));
+    }
+
+    std::vector<alias_table::entry> table(n);
+    std::memcpy(table.data(), records + n * sizeof(meta_cache_species),
+                n * sizeof(alias_table::entry));
+    sampler.assign(table.data(), n);
+
+    std::error_code ec;
+    std::filesystem::last_write_time(file_name(Jm, theta, seed),
+                                     std::filesystem::file_time_type::clock::now(), ec);
+    return true;
+  }
+
+  // stores the first num_species entries of registry; failures are
+  // silent, the cache is only an optimisation
+  static void store(size_t Jm, double theta, size_t seed,
+                    const std::vector<species>& registry, size_t num_species,
+                    const alias_table& sampler) {
+    if (!enabled() || sampler.size() != num_species) return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory(), ec);
+    const std::string name = file_name(Jm, theta, seed);
+    const std::string tmp_name = name + "." + temp_suffix();
+    {
+      std::ofstream out(tmp_name, std::ios::binary);
+      if (!out) return;
+
+      meta_cache_header header;
+      std::memcpy(header.magic, magic, sizeof(header.magic));
+      header.version = version;
+      header.fingerprint = fingerprint();
+      header.Jm = Jm;
+      header.theta = theta;
+      header.seed = seed;
+      header.num_species = num_species;
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+      for (size_t i = 0; i < num_species; ++i) {
+        meta_cache_species r = {};
+        r.count = registry[i].count_;
+        r.id = registry[i].id_;
+        for (size_t j = 0; j < 3; ++j) {
+          r.color[j] = static_cast<uint8_t>(registry[i].get_color()[j]);
+        }
+        out.write(reinterpret_cast<const char*>(&r), sizeof(r));
+      }
+      out.write(reinterpret_cast<const char*>(sampler.entries().data()),
+                num_species * sizeof(alias_table::entry));
+      if (!out) {
+        out.close();
+        std::filesystem::remove(tmp_name, ec);
+        return;
+      }
+    }
+    std::filesystem::rename(tmp_name, name, ec);
+    if (ec) std::filesystem::remove(tmp_name, ec);
+    evict();
+  }
+
+  // removes the least recently used cache files until the directory is
+  // below max_bytes
+  static void evict() {
+    if (!enabled() || max_bytes() == 0) return;
+    struct entry {
+      std::filesystem::path path;
+      std::filesystem::file_time_type time;
+      uint64_t size;
+    };
+    std::vector<entry> files;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(directory(), ec), end; !ec && it != end; it.increment(ec)) {
+      const auto name = it->path().filename().string();
+      if (name.compare(0, 5, "meta_") != 0 || it->path().extension() != ".bin") continue;
+      std::error_code file_ec;
+      const auto size = it->file_size(file_ec);
+      const auto time = it->last_write_time(file_ec);
+      if (file_ec) continue;
+      files.push_back(entry{it->path(), time, size});
+      total += size;
+    }
+    std::sort(files.begin(), files.end(), [](const entry& a, const entry& b) {
+      return a.time < b.time;
+    });
+    for (const auto& f : files) {
+      if (total <= max_bytes()) break;
+      if (std::filesystem::remove(f.path, ec)) total -= f.size;
+    }
+  }
+
+private:
+  static constexpr char magic[8] = {'N', 'T', 'Z', 'M', 'E', 'T', 'A', '\0'};
+  static constexpr uint64_t version = 2;
+  // bump when the metacommunity a (Jm, theta, seed) builds changes
+  static constexpr uint64_t algorithm_revision = 1;
+
+  static std::string& directory_ref() {
+    static std::string dir;
+    return dir;
+  }
+
+  static uint64_t& max_bytes_ref() {
+    static uint64_t max_bytes = uint64_t{256} << 20;
+    return max_bytes;
+  }
+
+  static uint64_t compute_fingerprint() {
+    uint64_t h = 0xcbf29ce484222325ull;
+    auto mix = [&h](uint64_t v) {
+      h ^= v;
+      h *= 0x100000001b3ull;
+    };
+    mix(algorithm_revision);
+    rnd_t rndgen(12345, 0, 0, 1);
+    auto abund = ewens_partition(1000, 10.0, rndgen);
+    alias_table sampler;
+    sampler.build(abund);
+    for (auto i : abund) mix(i);
+    for (const auto& e : sampler.entries()) {
+      uint32_t prob_bits;
+      std::memcpy(&prob_bits, &e.prob, sizeof(prob_bits));
+      mix(prob_bits);
+      mix(e.alias);
+    }
+    mix(sampler.sample(rndgen));
+    return h;
+  }
+
+  static std::string temp_suffix() {
+    std::ostringstream s;
+    s << std::hash<std::thread::id>()(std::this_thread::get_id()) << "_"
+      << std::chrono::steady_clock::now().time_since_epoch().count() << ".tmp";
+    return s.str();
+  }
+
+  // read-only view of a whole file: mmap where available, otherwise the
+  // file is read into memory
+  class mapped_file {
+  public:
+    explicit mapped_file(const std::string& name) {
+#ifdef META_CACHE_MMAP
+      int fd = ::open(name.c_str(), O_RDONLY);
+      if (fd < 0) return;
+      struct stat st;
+      if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+          map_ = p;
+          data_ = static_cast<const char*>(p);
+          size_ = static_cast<size_t>(st.st_size);
+        }
+      }
+      ::close(fd);
+#else
+      std::ifstream in(name, std::ios::binary);
+      if (!in) return;
+      buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+      data_ = buffer_.data();
+      size_ = buffer_.size();
+#endif
+    }
+
+    ~mapped_file() {
+#ifdef META_CACHE_MMAP
+      if (map_) ::munmap(map_, size_);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const char* data() const noexcept {
+      return data_;
+    }
+
+    size_t size() const noexcept {
+      return size_;
+    }
+
+  private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef META_CACHE_MMAP
+    void* map_ = nullptr;
+#else
+    std::vector<char> buffer_;
+#endif
+  };
+};
+
+#endif /* meta_cache_h */
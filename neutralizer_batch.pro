@@ -0,0 +1,35 @@
+TEMPLATE = app
+TARGET = neutralizer_batch
+
+CONFIG += c++17 console thread
+CONFIG -= qt app_bundle
+
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE += -O3
+
+SOURCES += \
+    batch_main.cpp
+
+HEADERS += \
+    alias_table.h \
+    block_aggregation.h \
+    cell.h \
+    coalescence.h \
+    dispersal.h \
+    dynamic_metacommunity.h \
+    ewens.h \
+    fenwick_tree.h \
+    fft.h \
+    hll_sketch.h \
+    kmc_engine.h \
+    lazy_metacommunity.h \
+    meta_cache.h \
+    pair_correlation.h \
+    rank_abundance.h \
+    rand_t.h \
+    replicate_runner.h \
+    simulation.h \
+    thread_pool.h \
+    tiled_engine.h \
+    well_mixed.h \
+    wright_fisher.h
@@ -0,0 +1,15 @@
+TEMPLATE = app
+TARGET = bench_meta_sampler
+
+CONFIG += c++17 console
+CONFIG -= qt app_bundle
+
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE += -O3
+
+SOURCES += \
+    bench_meta_sampler.cpp
+
+HEADERS += \
+    alias_table.h \
+    rand_t.h
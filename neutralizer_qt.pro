@@ -17,11 +17,28 @@ SOURCES += \
 
 HEADERS += \
     QScienceSpinBox.hpp \
+    alias_table.h \
+    block_aggregation.h \
     cell.h \
+    coalescence.h \
+    community_model.h \
+    dispersal.h \
+    dynamic_metacommunity.h \
+    ewens.h \
+    fenwick_tree.h \
+    fft.h \
+    hll_sketch.h \
+    kmc_engine.h \
+    lazy_metacommunity.h \
+    meta_cache.h \
+    pair_correlation.h \
+    rank_abundance.h \
     mainwindow.hpp \
     qcustomplot.h \
     rand_t.h \
-    simulation.h
+    simulation.h \
+    well_mixed.h \
+    wright_fisher.h
 
 FORMS += \
     mainwindow.ui
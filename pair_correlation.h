@@ -0,0 +1,245 @@
+//
+//  pair_correlation.h
+//  neutralizer_backbone
+//
+//  F(r): the probability that two individuals at distance r on the torus
+//  belong to the same species.
+//
+
+#ifndef pair_correlation_h
+#define pair_correlation_h
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <numeric>
+#include <complex>
+#include <cmath>
+#include <cstdint>
+#include "cell.h"
+#include "rand_t.h"
+#include "fft.h"
+
+struct pair_correlation_result {
+  std::vector<double> r;            // bin centre, 1, 2, ..., L / 2
+  std::vector<double> F;            // F_fft + F_tail
+  std::vector<double> F_fft;        // exact part of the abundant species
+  std::vector<double> F_tail;       // sampled part of all other species
+  std::vector<double> tail_error;   // standard error of F_tail
+  std::vector<size_t> num_offsets;  // lattice offsets in the bin
+};
+
+// F(dx, dy) = sum over species s of C_s(dx, dy) / N, where C_s counts the
+// cells i with i and i + (dx, dy) both of species s. Offsets are binned by
+// their (minimum image) distance, rounded, and every offset in a bin
+// weighs the same.
+//
+// The num_fft_species most abundant species are exact: C_s is the inverse
+// transform of |FFT(I_s)|^2 for the indicator field I_s. Only the sum over
+// species is needed, so the power spectra are summed and transformed back
+// once, and two real fields share each complex forward transform (in the
+// real and imaginary part). The transforms are split over threads, each
+// with a complex grid of its own (16 bytes per cell), and added to one
+// shared spectrum in species order, so the sum does not depend on the
+// number of threads. The grids take at most fft_memory_budget bytes,
+// which caps the number of threads for large L.
+//
+// The remaining species are sampled, stratified by bin: per bin,
+// samples_per_bin pairs (random cell, random offset of that bin), counting
+// pairs of the same species outside the exact set. Bin b samples on
+// stream (seed, replicate, b, sample_step) of rnd_t.
+class pair_correlation {
+public:
+  static constexpr size_t sample_step = size_t(1) << 62;
+  static constexpr size_t fft_memory_budget = size_t(1) << 30;
+
+  pair_correlation(const std::vector<species_index>& world, size_t L,
+                   const std::vector<size_t>& abundance,
+                   size_t num_fft_species = 16,
+                   size_t samples_per_bin = 10000,
+                   size_t num_threads = 1) :
+    world_(world), L_(L), abundance_(abundance),
+    num_fft_species_(num_fft_species),
+    samples_per_bin_(samples_per_bin),
+    num_threads_(std::max<size_t>(1, num_threads)) {}
+
+  pair_correlation_result run(size_t seed, size_t replicate = 0) {
+    pair_correlation_result out;
+    const size_t num_bins = L_ / 2;
+    if (num_bins == 0) return out;
+
+    choose_fft_species();
+    make_bins(num_bins);
+    auto exact = fft_part();
+
+    out.r.resize(num_bins);
+    out.F.resize(num_bins);
+    out.F_fft.assign(num_bins, 0.0);
+    out.F_tail.assign(num_bins, 0.0);
+    out.tail_error.assign(num_bins, 0.0);
+    out.num_offsets.resize(num_bins);
+
+    for (size_t b = 0; b < num_bins; ++b) {
+      out.r[b] = static_cast<double>(b + 1);
+      out.num_offsets[b] = bin_start_[b + 1] - bin_start_[b];
+      for (size_t i = bin_start_[b]; i < bin_start_[b + 1]; ++i) out.F_fft[b] += exact[offsets_[i]];
+      if (out.num_offsets[b] > 0) out.F_fft[b] /= out.num_offsets[b];
+    }
+
+    if (has_tail_ && samples_per_bin_ > 0) {
+      parallel_for(num_bins, [&](size_t b) {
+        if (bin_start_[b + 1] == bin_start_[b]) return;
+        const double p = sample_bin(b, seed, replicate);
+        out.F_tail[b] = p;
+        out.tail_error[b] = std::sqrt(p * (1.0 - p) / samples_per_bin_);
+      });
+    }
+    for (size_t b = 0; b < num_bins; ++b) out.F[b] = out.F_fft[b] + out.F_tail[b];
+    return out;
+  }
+
+private:
+  using cplx = std::complex<double>;
+
+  const std::vector<species_index>& world_;
+  size_t L_;
+  const std::vector<size_t>& abundance_;
+  size_t num_fft_species_;
+  size_t samples_per_bin_;
+  size_t num_threads_;
+
+  std::vector<species_index> fft_species_;
+  std::vector<uint8_t> is_fft_species_;   // by registry index
+  bool has_tail_ = false;
+  std::vector<size_t> bin_start_;         // offsets of bin b: [bin_start_[b], bin_start_[b + 1])
+  std::vector<uint32_t> offsets_;         // dx * L + dy
+
+  void choose_fft_species() {
+    std::vector<species_index> present;
+    for (size_t s = 0; s < abundance_.size(); ++s) {
+      if (abundance_[s] > 0) present.push_back(static_cast<species_index>(s));
+    }
+    const size_t k = std::min(num_fft_species_, present.size());
+    std::partial_sort(present.begin(), present.begin() + k, present.end(),
+                      [&](species_index a, species_index b) { return abundance_[a] > abundance_[b]; });
+    fft_species_.assign(present.begin(), present.begin() + k);
+    is_fft_species_.assign(abundance_.size(), 0);
+    for (auto s : fft_species_) is_fft_species_[s] = 1;
+    has_tail_ = present.size() > k;
+  }
+
+  void make_bins(size_t num_bins) {
+    // num_bins <= L / 2 fits, as the offsets do
+    std::vector<uint32_t> bin_of(L_ * L_, static_cast<uint32_t>(num_bins));
+    bin_start_.assign(num_bins + 1, 0);
+    for (size_t dx = 0; dx < L_; ++dx) {
+      const double ddx = static_cast<double>(std::min(dx, L_ - dx));
+      for (size_t dy = 0; dy < L_; ++dy) {
+        const double ddy = static_cast<double>(std::min(dy, L_ - dy));
+        const auto b = static_cast<size_t>(std::lround(std::sqrt(ddx * ddx + ddy * ddy)));
+        if (b == 0 || b > num_bins) continue;
+        bin_of[dx * L_ + dy] = static_cast<uint32_t>(b - 1);
+        bin_start_[b]++;
+      }
+    }
+    std::partial_sum(bin_start_.begin(), bin_start_.end(), bin_start_.begin());
+    offsets_.resize(bin_start_.back());
+    auto fill = bin_start_;
+    for (size_t i = 0; i < bin_of.size(); ++i) {
+      if (bin_of[i] < num_bins) offsets_[fill[bin_of[i]]++] = static_cast<uint32_t>(i);
+    }
+  }
+
+  // sum over the exact species of C_s(dx, dy) / N, for every offset
+  std::vector<double> fft_part() {
+    const size_t N = L_ * L_;
+    std::vector<double> power(N, 0.0);
+    if (fft_species_.empty()) return power;
+
+    const size_t num_pairs = (fft_species_.size() + 1) / 2;
+    const size_t max_grids = std::max<size_t>(1, fft_memory_budget / (N * sizeof(cplx)));
+    const size_t num_threads = std::min({num_threads_, num_pairs, max_grids});
+    std::vector<std::vector<cplx>> grids(num_threads);
+
+    // pair p is added to power once pairs 0 .. p - 1 are
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t next_pair = 0;
+
+    auto work = [&](size_t t) {
+      fft_plan plan(L_);
+      auto& grid = grids[t];
+      grid.resize(N);
+      for (size_t p = t; p < num_pairs; p += num_threads) {
+        const species_index a = fft_species_[2 * p];
+        const bool has_b = 2 * p + 1 < fft_species_.size();
+        const species_index b = has_b ? fft_species_[2 * p + 1] : a;
+        for (size_t i = 0; i < N; ++i) {
+          grid[i] = cplx(world_[i] == a ? 1.0 : 0.0, has_b && world_[i] == b ? 1.0 : 0.0);
+        }
+        plan.forward_2d(grid);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return next_pair == p; });
+        // with Z = FFT(I_a + i I_b): |A_k|^2 + |B_k|^2 = (|Z_k|^2 + |Z_-k|^2) / 2
+        for (size_t x = 0; x < L_; ++x) {
+          for (size_t y = 0; y < L_; ++y) {
+            const size_t k = x * L_ + y;
+            const size_t minus_k = ((L_ - x) % L_) * L_ + (L_ - y) % L_;
+            power[k] += 0.5 * (std::norm(grid[k]) + std::norm(grid[minus_k]));
+          }
+        }
+        next_pair++;
+        lock.unlock();
+        cv.notify_all();
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; ++t) threads.emplace_back(work, t);
+    work(0);
+    for (auto& i : threads) i.join();
+
+    // the spectrum is transformed back in the first grid, the others go
+    grids.resize(1);
+    auto& grid = grids[0];
+    for (size_t i = 0; i < N; ++i) grid[i] = cplx(power[i], 0.0);
+    fft_plan plan(L_);
+    plan.inverse_2d(grid);
+    // the inverse is unnormalised (factor N), and F divides by N pairs
+    for (size_t i = 0; i < N; ++i) power[i] = grid[i].real() / N / N;
+    return power;
+  }
+
+  double sample_bin(size_t b, size_t seed, size_t replicate) const {
+    rnd_t rndgen(seed, replicate, b, sample_step);
+    const size_t N = L_ * L_;
+    const size_t first = bin_start_[b];
+    const size_t count = bin_start_[b + 1] - first;
+    size_t hits = 0;
+    for (size_t i = 0; i < samples_per_bin_; ++i) {
+      const size_t cell = rndgen.random_number(N);
+      const uint32_t offset = offsets_[first + rndgen.random_number(count)];
+      const size_t x = (cell / L_ + offset / L_) % L_;
+      const size_t y = (cell % L_ + offset % L_) % L_;
+      const species_index s = world_[cell];
+      if (world_[x * L_ + y] == s && !is_fft_species_[s]) hits++;
+    }
+    return static_cast<double>(hits) / samples_per_bin_;
+  }
+
+  template <typename F>
+  void parallel_for(size_t n, F f) const {
+    const size_t num_threads = std::min(num_threads_, std::max<size_t>(1, n));
+    auto work = [&](size_t t) {
+      for (size_t i = t; i < n; i += num_threads) f(i);
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; ++t) threads.emplace_back(work, t);
+    work(0);
+    for (auto& i : threads) i.join();
+  }
+};
+
+#endif /* pair_correlation_h */
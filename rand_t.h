@@ -4,61 +4,209 @@
 #include <chrono>
 #include <thread>
 #include <type_traits>
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+// xoshiro256++ (Blackman & Vigna): 32 bytes of state, a handful of
+// instructions per 64-bit output. Satisfies UniformRandomBitGenerator, so
+// the <random> distributions still work on top of it.
+struct xoshiro256pp {
+  using result_type = uint64_t;
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~result_type(0); }
+
+  xoshiro256pp(uint64_t seed = 42) {
+    seed_with(seed);
+  }
+
+  void seed_with(uint64_t seed) {
+    // splitmix64 expands the seed into a well mixed, non-zero state
+    for (auto& i : s) {
+      seed += 0x9e3779b97f4a7c15ULL;
+      uint64_t z = seed;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      i = z ^ (z >> 31);
+    }
+  }
+
+  result_type operator()() noexcept {
+    const uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+  }
+
+  uint64_t s[4];
+
+private:
+  static uint64_t rotl(const uint64_t x, int k) noexcept {
+    return (x << k) | (x >> (64 - k));
+  }
+};
+
+// Philox4x32-10 (Salmon et al. 2011): a counter-based generator, i.e. a
+// keyed bijection of a 128-bit counter. Every counter value gives an
+// independent 128-bit block, no sequential state is involved.
+struct philox4x32 {
+  using block = std::array<uint32_t, 4>;
+
+  static block generate(block ctr, uint64_t key) {
+    uint32_t k0 = static_cast<uint32_t>(key);
+    uint32_t k1 = static_cast<uint32_t>(key >> 32);
+    for (int r = 0; r < 10; ++r) {
+      if (r > 0) {
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+      }
+      const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * ctr[0];
+      const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * ctr[2];
+      ctr = {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ k0,
+             static_cast<uint32_t>(p1),
+             static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ k1,
+             static_cast<uint32_t>(p0)};
+    }
+    return ctr;
+  }
+};
 
 struct rnd_t {
-  std::mt19937 rndgen;
+  xoshiro256pp rndgen;
+
+  rnd_t() : rnd_t(static_cast<size_t>(get_seed()), 0, 0, 0) {
+  }
 
-  rnd_t() {
-    std::mt19937 rndgen_t(get_seed());
-    rndgen = rndgen_t;
+  rnd_t(size_t seed) : rnd_t(seed, 0, 0, 0) {
   }
 
-  rnd_t(size_t seed) {
-    std::mt19937 rndgen_t(seed);
-    rndgen = rndgen_t;
+  // Stream (seed, replicate, tile, step). The engine state is the Philox
+  // output for that counter, so any stream can be created directly, on
+  // any thread and in any order, and always produces the same numbers.
+  rnd_t(size_t seed, size_t replicate, size_t tile, size_t step) {
+    set_stream(seed, replicate, tile, step);
   }
 
-  int get_seed() {
-    const auto tt = static_cast<int64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+  void set_stream(size_t seed, size_t replicate, size_t tile, size_t step) {
+    const uint64_t key = static_cast<uint64_t>(seed);
+    philox4x32::block ctr = {static_cast<uint32_t>(replicate),
+                             static_cast<uint32_t>(tile),
+                             static_cast<uint32_t>(step),
+                             static_cast<uint32_t>(static_cast<uint64_t>(step) >> 32) & 0x7fffffffu};
+    auto a = philox4x32::generate(ctr, key);
+    ctr[3] |= 0x80000000u; // second block of the same stream
+    auto b = philox4x32::generate(ctr, key);
+    rndgen.s[0] = (static_cast<uint64_t>(a[0]) << 32) | a[1];
+    rndgen.s[1] = (static_cast<uint64_t>(a[2]) << 32) | a[3];
+    rndgen.s[2] = (static_cast<uint64_t>(b[0]) << 32) | b[1];
+    rndgen.s[3] = (static_cast<uint64_t>(b[2]) << 32) | b[3];
+    if ((rndgen.s[0] | rndgen.s[1] | rndgen.s[2] | rndgen.s[3]) == 0) {
+      rndgen.s[0] = 1; // xoshiro must not start from the all-zero state
+    }
+  }
+
+  static int get_seed() {
+    const auto tt = static_cast<uint64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count());
     //auto tid = std::this_thread::get_id();
     //const uint64_t e3{ std::hash<std::remove_const_t<decltype(tid)>>()(tid) };
-    const auto e3 = 0.0;
-    auto output = static_cast<int>(tt + e3);
-    if (output < 0) output *= -1;
+    // fold the clock into 31 bits: going through a double (as before)
+    // overflowed the int cast and gave the same seed on every run.
+    auto output = static_cast<int>((tt ^ (tt >> 32)) & 0x7fffffff);
     return output;
   }
 
-  std::uniform_real_distribution<float> unif_dist =
-    std::uniform_real_distribution<float>(0.0f, 1.0f);
-
-
-  std::uniform_int_distribution<> world_dist;
-
+  // uniform in [0, n), Lemire's nearly divisionless method: the modulo is
+  // only evaluated on the rare draws that fall in the biased low range.
   size_t random_number(size_t n)    {
     if(n <= 1) return 0;
-    return static_cast<size_t>(std::uniform_int_distribution<> (0, static_cast<int>(n - 1))(rndgen));
+    if (n <= 0xffffffffULL) return bounded32(static_cast<uint32_t>(n));
+    return bounded64(n);
   }
 
   size_t random_pos() {
-    return static_cast<size_t>(world_dist(rndgen));
+    return bounded32(world_size_);
   }
 
   void set_world_size(size_t world_size) {
-    world_dist = std::uniform_int_distribution<>(0, static_cast<int>(world_size) - 1);
+    world_size_ = static_cast<uint32_t>(world_size);
   }
 
+  // 32 raw random bits, for picking among a power of two of options
+  uint32_t random_bits() {
+    return static_cast<uint32_t>(rndgen());
+  }
+
+  // uniform in [0, 1), from the top 24 bits (the float mantissa)
   float uniform()    {
-    return unif_dist(rndgen);
+    return static_cast<float>(rndgen() >> 40) * 0x1.0p-24f;
+  }
+
+  // uniform in [0, 1) with 53 bits, for steps where float is too coarse
+  double uniform_double() {
+    return static_cast<double>(rndgen() >> 11) * 0x1.0p-53;
   }
 
   void set_seed(unsigned seed)    {
-    std::mt19937 new_randomizer(seed);
-    rndgen = new_randomizer;
+    set_stream(seed, 0, 0, 0);
   }
 
+  // P(true) = p. Hot loops should precompute the threshold once with
+  // bernouilli_threshold() and call below_threshold() instead.
   bool bernouilli(double p) {
-    std::bernoulli_distribution d(p);
-    return(d(rndgen));
+    return below_threshold(bernouilli_threshold(p));
+  }
+
+  static uint64_t bernouilli_threshold(double p) {
+    if (p <= 0.0) return 0;
+    if (p >= 1.0) return ~uint64_t(0);
+    return static_cast<uint64_t>(p * 0x1.0p64);
+  }
+
+  bool below_threshold(uint64_t threshold) {
+    return rndgen() < threshold;
+  }
+
+  uint32_t bounded32(uint32_t n) {
+    uint64_t m = (rndgen() >> 32) * static_cast<uint64_t>(n);
+    uint32_t l = static_cast<uint32_t>(m);
+    if (l < n) {
+      const uint32_t t = (0u - n) % n;
+      while (l < t) {
+        m = (rndgen() >> 32) * static_cast<uint64_t>(n);
+        l = static_cast<uint32_t>(m);
+      }
+    }
+    return static_cast<uint32_t>(m >> 32);
+  }
+
+private:
+  uint32_t world_size_ = 1;
+
+  size_t bounded64(uint64_t n) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 m = static_cast<unsigned __int128>(rndgen()) * n;
+    uint64_t l = static_cast<uint64_t>(m);
+    if (l < n) {
+      const uint64_t t = (0 - n) % n;
+      while (l < t) {
+        m = static_cast<unsigned __int128>(rndgen()) * n;
+        l = static_cast<uint64_t>(m);
+      }
+    }
+    return static_cast<size_t>(m >> 64);
+#else
+    // plain rejection on compilers without 128-bit integers
+    const uint64_t limit = ~uint64_t(0) - (~uint64_t(0) % n);
+    uint64_t x = rndgen();
+    while (x >= limit) x = rndgen();
+    return static_cast<size_t>(x % n);
+#endif
   }
 };
 
@@ -0,0 +1,101 @@
+//
+//  rank_abundance.h
+//  neutralizer_backbone
+//
+//  Counts of counts, kept up to date while abundances change by one at a
+//  time, so the rank abundance curve never has to be sorted.
+//
+
+#ifndef rank_abundance_h
+#define rank_abundance_h
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// at_least_[a] is the number of species with abundance >= a. A species
+// going from a to a + 1 only changes at_least_[a + 1], and going down only
+// changes at_least_[a], so updates are O(1). at_least_ is non-increasing
+// in a, and the species at rank r (0 being the most abundant) has the
+// largest abundance a with at_least_[a] > r, found by binary search.
+// Identities of species are not kept; the curve does not need them.
+//
+// at_least_ only reaches as far as the largest abundance seen, not the
+// number of individuals: it grows in increment(), and assign() sizes it
+// to the largest abundance given.
+class rank_abundance {
+public:
+  // all species absent
+  void reset() {
+    at_least_.assign(2, 0);
+    max_ = 0;
+  }
+
+  // all species at once, from their abundances (zeros are absent
+  // species), O(max_abundance + number of species)
+  void assign(const std::vector<size_t>& abundances) {
+    max_ = 0;
+    for (auto a : abundances) {
+      if (a > max_) max_ = a;
+    }
+    at_least_.assign(max_ + 2, 0);
+    for (auto a : abundances) {
+      if (a > 0) at_least_[a]++;
+    }
+    for (size_t a = max_; a > 1; --a) at_least_[a - 1] += at_least_[a];
+  }
+
+  // a species had abundance a and now has a + 1
+  void increment(size_t a) {
+    if (a + 2 > at_least_.size()) at_least_.resize(a + 2, 0);
+    at_least_[a + 1]++;
+    if (a + 1 > max_) max_ = a + 1;
+  }
+
+  // a species had abundance a and now has a - 1
+  void decrement(size_t a) {
+    if (--at_least_[a] == 0 && a == max_) max_--;
+  }
+
+  // number of species present
+  size_t size() const noexcept {
+    return max_ > 0 ? at_least_[1] : 0;
+  }
+
+  size_t max_abundance() const noexcept {
+    return max_;
+  }
+
+  // abundance at rank r; requires r < size()
+  size_t at_rank(size_t r) const {
+    size_t lo = 1;         // at_least_[lo] > r
+    size_t hi = max_ + 1;  // at_least_[hi] <= r
+    while (hi - lo > 1) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (at_least_[mid] > r) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  // all abundances in decreasing order, O(max_abundance + size)
+  template <typename T>
+  void fill(std::vector<T>& out) const {
+    out.clear();
+    out.reserve(size());
+    for (size_t a = max_; a > 0; --a) {
+      for (size_t i = at_least_[a + 1]; i < at_least_[a]; ++i) {
+        out.push_back(static_cast<T>(a));
+      }
+    }
+  }
+
+private:
+  std::vector<uint32_t> at_least_;
+  size_t max_ = 0;
+};
+
+#endif /* rank_abundance_h */
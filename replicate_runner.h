@@ -0,0 +1,164 @@
+//
+//  replicate_runner.h
+//  neutralizer_backbone
+//
+//  Runs many independent replicates of a simulation on a work-stealing
+//  pool, streams every replicate's time series to its own file and keeps
+//  across-replicate mean and variance of richness and octaves.
+//
+
+#ifndef replicate_runner_h
+#define replicate_runner_h
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include "thread_pool.h"
+
+// running count, sum and sum of squares, updated without locks
+class atomic_accumulator {
+public:
+  void add(double x) {
+    n_.fetch_add(1, std::memory_order_relaxed);
+    atomic_add(sum_, x);
+    atomic_add(sum_sq_, x * x);
+  }
+
+  size_t count() const {
+    return n_.load();
+  }
+
+  double mean() const {
+    size_t n = n_.load();
+    return n > 0 ? sum_.load() / n : 0.0;
+  }
+
+  // unbiased sample variance
+  double variance() const {
+    size_t n = n_.load();
+    if (n < 2) return 0.0;
+    double m = sum_.load() / n;
+    return std::max(0.0, (sum_sq_.load() - n * m * m) / (n - 1));
+  }
+
+private:
+  std::atomic<size_t> n_{0};
+  std::atomic<double> sum_{0.0};
+  std::atomic<double> sum_sq_{0.0};
+
+  static void atomic_add(std::atomic<double>& target, double x) {
+    double old_val = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(old_val, old_val + x,
+                                         std::memory_order_relaxed)) {}
+  }
+};
+
+struct replicate_settings {
+  size_t num_replicates = 1;
+  size_t num_threads = 0;         // 0: one per core
+  size_t num_samples = 1;         // time points after t = 0
+  size_t events_per_sample = 1;
+  std::string prefix = "neutralizer";
+};
+
+// SIM is a simulation_t or a well_mixed_simulation
+template <typename SIM>
+class replicate_runner {
+public:
+  using sim_ptr = std::unique_ptr< SIM >;
+  // builds the simulation of one replicate, typically with the replicate
+  // index as its stream so replicates are independent and reproducible
+  using factory = std::function< sim_ptr(size_t replicate) >;
+
+  static constexpr size_t max_octaves = 64;
+
+  replicate_runner(factory make_sim, const replicate_settings& settings) :
+    make_sim_(make_sim),
+    settings_(settings),
+    richness_(settings.num_samples + 1),
+    octaves_((settings.num_samples + 1) * max_octaves) {}
+
+  // runs all replicates and writes <prefix>_rep<i>.txt per replicate plus
+  // <prefix>_summary.txt, <prefix>_octaves_mean.txt and _octaves_var.txt
+  void run() {
+    work_stealing_pool pool(settings_.num_threads);
+    for (size_t r = 0; r < settings_.num_replicates; ++r) {
+      pool.submit([this, r] { run_replicate(r); });
+    }
+    pool.wait_idle();
+    write_summary();
+  }
+
+  const std::vector<atomic_accumulator>& richness() const {
+    return richness_;
+  }
+
+  // accumulator of octave k at sample i
+  const atomic_accumulator& octave(size_t sample, size_t k) const {
+    return octaves_[sample * max_octaves + k];
+  }
+
+private:
+  factory make_sim_;
+  replicate_settings settings_;
+  std::vector<atomic_accumulator> richness_;
+  std::vector<atomic_accumulator> octaves_;
+  std::atomic<size_t> num_cells_{1};
+
+  void run_replicate(size_t replicate) {
+    auto sim = make_sim_(replicate);
+    std::ofstream out(settings_.prefix + "_rep" + std::to_string(replicate) + ".txt");
+    const double cells = static_cast<double>(sim->L * sim->L);
+    num_cells_ = sim->L * sim->L;
+
+    for (size_t i = 0; i <= settings_.num_samples; ++i) {
+      if (i > 0) {
+        for (size_t j = 0; j < settings_.events_per_sample; ++j) sim->update();
+      }
+      sim->update_stats();
+      const double gen = sim->t / cells;
+      const auto& octaves = sim->get_local_octaves();
+
+      richness_[i].add(sim->num_species());
+      for (size_t k = 0; k < octaves.size() && k < max_octaves; ++k) {
+        octaves_[i * max_octaves + k].add(octaves[k]);
+      }
+
+      out << gen << "\t" << sim->num_species();
+      for (auto k : octaves) out << "\t" << k;
+      out << "\n";
+    }
+  }
+
+  void write_summary() const {
+    size_t num_octaves = 0;
+    for (size_t i = 0; i < octaves_.size(); ++i) {
+      if (octaves_[i].mean() > 0.0) num_octaves = std::max(num_octaves, 1 + i % max_octaves);
+    }
+
+    std::ofstream out(settings_.prefix + "_summary.txt");
+    std::ofstream out_mean(settings_.prefix + "_octaves_mean.txt");
+    std::ofstream out_var(settings_.prefix + "_octaves_var.txt");
+    out << "generation\treplicates\tmean_species\tvar_species\n";
+    for (size_t i = 0; i < richness_.size(); ++i) {
+      const double gen = 1.0 * i * settings_.events_per_sample / num_cells_;
+      out << gen << "\t" << richness_[i].count() << "\t"
+          << richness_[i].mean() << "\t" << richness_[i].variance() << "\n";
+      out_mean << gen;
+      out_var << gen;
+      for (size_t k = 0; k < num_octaves; ++k) {
+        out_mean << "\t" << octave(i, k).mean();
+        out_var << "\t" << octave(i, k).variance();
+      }
+      out_mean << "\n";
+      out_var << "\n";
+    }
+  }
+};
+
+#endif /* replicate_runner_h */
@@ -12,126 +12,320 @@
 #include <vector>
 #include "cell.h"
 #include "rand_t.h"
+#include "alias_table.h"
+#include "dispersal.h"
+#include "ewens.h"
+#include "lazy_metacommunity.h"
+#include "dynamic_metacommunity.h"
+#include "meta_cache.h"
+#include "rank_abundance.h"
+#include "block_aggregation.h"
+#include "hll_sketch.h"
+#include "pair_correlation.h"
 #include <algorithm>
-#include <map>
 #include <cmath>
-
-class simulation {
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+// fixed: the metacommunity is built up front by create_meta_community.
+// lazy: species are drawn on demand, see lazy_metacommunity.h; Jm = 0 is
+// then the infinite (logseries) metacommunity.
+// dynamic: the metacommunity drifts along with the local community, see
+// dynamic_metacommunity.h.
+enum class metacommunity_mode { fixed, lazy, dynamic };
+
+template <typename DISPERSAL>
+class simulation_t {
 private:
-
-
-  std::vector< cell > world;
-  std::vector< species > meta_community;
+  // parallel update engine, see tiled_engine.h
+  template <typename> friend class tiled_engine;
+  // backward-time equilibrium, see coalescence.h
+  template <typename> friend class coalescence_engine;
+  // event-driven updates that skip no-op events, see kmc_engine.h
+  template <typename> friend class kmc_engine;
+  // generation-synchronous updates, see wright_fisher.h
+  template <typename> friend class wright_fisher_engine;
+
+
+  // each cell only stores the index of its species in species_registry;
+  // the first meta_community_size entries of the registry are the
+  // metacommunity species, new species are appended after speciation.
+  std::vector< species_index > world;
+  std::vector< species > species_registry;
+  size_t meta_community_size;
   std::vector<int> meta_community_octaves;
-  std::map<int, int> histogram_local_comm;
+  // Preston octaves of the local community, bin k counts the species with
+  // 2^k <= abundance < 2^(k + 1); kept up to date by add_individual and
+  // remove_individual
   std::vector<int> local_community_octaves;
 
-
-  std::vector<double> cdf_;
-
+  // number of individuals per registry entry, kept up to date by update().
+  // Extinct species that arose through speciation are recycled through
+  // free_species_; metacommunity species keep their index.
+  std::vector< size_t > abundance_;
+  std::vector< species_index > free_species_;
+  size_t num_species_;
+  // number of species per abundance, see rank_abundance.h
+  rank_abundance ranks_;
+  // scratch space of update_species_area
+  std::vector< uint32_t > sar_first_side_;
+
+
+  // draws metacommunity species (registry index) proportional to count_
+  alias_table meta_sampler_;
+
+  // lazy mode only: the metacommunity, the registry index of each of its
+  // species that has immigrated so far (or no_species), and which registry
+  // entries belong to such species and may not be recycled
+  std::unique_ptr< lazy_metacommunity > lazy_meta_;
+  std::vector< species_index > meta_to_registry_;
+  std::vector< bool > pinned_;
+  static constexpr species_index no_species = ~species_index(0);
+
+  // dynamic mode only: the metacommunity and the registry index of each
+  // of its species that is present locally, by species id. Registry
+  // entries of these species are recycled as usual; their id_ is the
+  // metacommunity id.
+  std::unique_ptr< dynamic_metacommunity > dynamic_meta_;
+  std::unordered_map< uint64_t, species_index > dynamic_to_registry_;
+
+  // serial stream (seed_, replicate_, 0, 0), see rnd_t
   rnd_t rndgen_;
+  const size_t seed_;
+  const size_t replicate_;
+  // number of parallel phases run so far, part of the tile stream key
+  size_t parallel_step_ = 0;
 
   const double prob_same;
   const double rel_prob_spec;
+  // the same probabilities as integer thresholds for rnd_t::below_threshold
+  const uint64_t prob_same_threshold_;
+  const uint64_t rel_prob_spec_threshold_;
 
   const double dispersal_range;
+  // dispersal kernel policy, see dispersal.h
+  const DISPERSAL dispersal_;
 
 public:
   size_t t;
     size_t L;
   std::vector<double> rank_abund_curve;
 
-  simulation(size_t one_side,
+  simulation_t(size_t one_side,
              double sp,
              double mgr,
              size_t meta_comm_size,
              double disp_range,
              double theta,
-             bool init_mono_dom) :
+             bool init_mono_dom,
+             size_t seed,
+             size_t replicate = 0,
+             metacommunity_mode meta_mode = metacommunity_mode::fixed,
+             double meta_rate = 1.0,
+             bool meta_background = false) :
     L(one_side),
     world(one_side * one_side),
+    seed_(seed),
+    replicate_(replicate),
     prob_same(1.0 - sp - mgr),
     rel_prob_spec(sp / (sp + mgr)),
+    prob_same_threshold_(rnd_t::bernouilli_threshold(1.0 - sp - mgr)),
+    rel_prob_spec_threshold_(rnd_t::bernouilli_threshold(sp / (sp + mgr))),
     dispersal_range(disp_range),
+    dispersal_(disp_range, one_side),
     t(0)
   {
-    rndgen_ = rnd_t();
+    rndgen_ = rnd_t(seed_, replicate_, 0, 0);
     rndgen_.set_world_size(one_side * one_side);
-    create_meta_community(meta_comm_size, theta);
-    size_t cnt = 0;
+    if (meta_mode == metacommunity_mode::lazy) {
+        // the same stream as create_meta_community, which no other part
+        // of the simulation uses
+        lazy_meta_ = std::make_unique<lazy_metacommunity>(meta_comm_size, theta,
+                                                          rnd_t(seed_, 0, 0, 1));
+        meta_community_size = 0;
+      } else if (meta_mode == metacommunity_mode::dynamic) {
+        // meta_rate: metacommunity steps per local event; meta_background
+        // trades reproducibility for a metacommunity in its own thread
+        dynamic_meta_ = std::make_unique<dynamic_metacommunity>(meta_comm_size, theta, meta_rate,
+                                                                rnd_t(seed_, replicate_, 0, 2),
+                                                                meta_background);
+        meta_community_size = 0;
+      } else {
+        create_meta_community(meta_comm_size, theta);
+      }
 
     auto mono_dom_spec = get_species_from_meta_community();
 
     for (auto& i : world) {
         if (init_mono_dom) {
-            i.set_species(mono_dom_spec);
+            i = mono_dom_spec;
           } else {
-            i.set_species( get_species_from_meta_community() );
+            i = get_species_from_meta_community();
           }
+      }
+
+    recount();
+  }
 
-        i.set_xy(cnt, L);
-        cnt++;
+  // rebuilds abundances, octaves, ranks and the free list from world,
+  // after world has been filled other than by update()
+  void recount() {
+    std::vector< size_t > abundance(species_registry.size(), 0);
+    for (const auto& i : world) {
+        abundance[i]++;
       }
+    set_abundances(std::move(abundance));
   }
 
+  // as recount(), from the number of individuals of every registry entry
+  // instead of a pass over world
+  void set_abundances(std::vector< size_t > abundance) {
+    abundance_ = std::move(abundance);
+    abundance_.resize(species_registry.size(), 0);
+    num_species_ = 0;
+    local_community_octaves.assign(1 + octave_of(world.size()), 0);
+    ranks_.assign(abundance_);
+    for (auto n : abundance_) {
+        if (n == 0) continue;
+        num_species_++;
+        local_community_octaves[octave_of(n)]++;
+      }
+    free_species_.clear();
+    for (size_t s = meta_community_size; s < species_registry.size(); ++s) {
+        if (abundance_[s] > 0 || pinned_[s]) continue;
+        if (dynamic_meta_) {
+            auto it = dynamic_to_registry_.find(species_registry[s].id_);
+            if (it != dynamic_to_registry_.end() && it->second == s) dynamic_to_registry_.erase(it);
+          }
+        free_species_.push_back(static_cast<species_index>(s));
+      }
+  }
 
-  std::vector < species > create_meta_community(size_t Jm, double theta) {
 
-    std::vector<int> abund(1,0);
-    std::size_t nsp = 1;
-    abund.push_back(1);
+  // metacommunity species abundances follow the Ewens partition, see
+  // ewens.h. The metacommunity is built on stream (seed, 0, 0, 1), so it
+  // depends on (Jm, theta, seed) only and all replicates of a seed share
+  // it; that is also the key under which it is cached, see meta_cache.h.
+  void create_meta_community(size_t Jm, double theta) {
 
-    for(size_t j = 1; j < Jm; ++j) {
-        double x = static_cast<double>(rndgen_.uniform());
-        double val = theta / (theta + j - 1);
-        if(x < val) {
-            nsp++;
-            if(nsp > (abund.size()-1)) {
-                size_t dif = 1 + nsp - abund.size();
-                for(size_t k = 0; k < dif; ++k) {
-                    abund.push_back(0);
-                  }
-              }
-            abund[nsp] = 1;
+    if (!meta_cache::load(Jm, theta, seed_, species_registry, meta_sampler_)) {
+        rnd_t meta_rndgen(seed_, 0, 0, 1);
+        auto abund = ewens_partition(Jm, theta, meta_rndgen);
+
+        species_registry.clear();
+        for(std::size_t i = 0; i < abund.size() ;++i) {
+            species_registry.push_back(species(abund[i], meta_rndgen));
           }
-        else {
-            int translate_to_abund = static_cast<int>((x * j) - 1);
-            //now find corresponding species
-            std::size_t index = 0;
-            while(index < abund.size()) {
-                translate_to_abund -= abund[index];
-                if(translate_to_abund <= 0) break;
-
-                index++;
-              }
 
-            abund[index] = abund[index] + 1;
+        std::vector<size_t> meta_abund(species_registry.size());
+        for (size_t i = 0; i < species_registry.size(); ++i) {
+            meta_abund[i] = species_registry[i].count_;
           }
+        meta_sampler_.build(meta_abund);
+
+        meta_cache::store(Jm, theta, seed_, species_registry, species_registry.size(), meta_sampler_);
       }
+    meta_community_size = species_registry.size();
+    pinned_.assign(meta_community_size, false);
 
-    meta_community.clear();
+    update_octave_meta_comm();
+  }
 
-    for(std::size_t i = 0; i < abund.size() ;++i) {
-      if (abund[i] > 0) {
-          meta_community.push_back(species(abund[i], rndgen_));
-        }
-    }
+  species_index get_species_from_meta_community() {
+    if (lazy_meta_) return lazy_species(lazy_meta_->sample(rndgen_));
+    if (dynamic_meta_) return dynamic_species();
+    return static_cast<species_index>(meta_sampler_.sample(rndgen_));
+  }
 
-    double cumsum = 0.0;
-    for (const auto& i : meta_community) {
-        cumsum += i.count_;
-        cdf_.push_back(cumsum);
+  // true if the metacommunity sampler may be used from several threads
+  bool is_meta_sampler_shared() const noexcept {
+    return !lazy_meta_ && !dynamic_meta_;
+  }
+
+  // registry index of species k of the lazy metacommunity, created the
+  // first time k immigrates
+  species_index lazy_species(size_t k) {
+    if (k >= meta_to_registry_.size()) meta_to_registry_.resize(k + 1, no_species);
+    if (meta_to_registry_[k] == no_species) {
+        auto index = new_species();
+        species_registry[index].count_ = lazy_meta_->is_infinite() ? 0 : lazy_meta_->abundance(k);
+        pinned_[index] = true;
+        meta_to_registry_[k] = index;
       }
+    return meta_to_registry_[k];
+  }
 
-    update_octave_meta_comm();
+  species_index dynamic_species() {
+    dynamic_meta_->set_clock(t);
+    auto d = dynamic_meta_->sample(rndgen_);
+    auto it = dynamic_to_registry_.find(d.id);
+    if (it != dynamic_to_registry_.end()) return it->second;
+    auto index = new_species();
+    // the colour follows from the id, so a species that immigrates again
+    // after going extinct locally looks the same
+    rnd_t colour_rndgen(d.id);
+    species_registry[index] = species(d.count, colour_rndgen);
+    species_registry[index].id_ = d.id;
+    dynamic_to_registry_[d.id] = index;
+    return index;
+  }
+
+  species_index new_species() {
+    if (!free_species_.empty()) {
+        auto index = free_species_.back();
+        free_species_.pop_back();
+        species_registry[index] = species(1, rndgen_);
+        return index;
+      }
+    species_registry.push_back(species(1, rndgen_));
+    abundance_.push_back(0);
+    pinned_.push_back(false);
+    return static_cast<species_index>(species_registry.size() - 1);
+  }
+
+  // an abundance only changes octave when it reaches or leaves a power
+  // of two
+  void add_individual(species_index s) {
+    const size_t n = ++abundance_[s];
+    ranks_.increment(n - 1);
+    if ((n & (n - 1)) == 0) {
+        const size_t oct = octave_of(n);
+        local_community_octaves[oct]++;
+        if (oct > 0) {
+            local_community_octaves[oct - 1]--;
+          } else {
+            num_species_++;
+          }
+      }
+  }
 
-    return meta_community;
+  void remove_individual(species_index s) {
+    const size_t n = abundance_[s]--;
+    ranks_.decrement(n);
+    if ((n & (n - 1)) == 0) {
+        const size_t oct = octave_of(n);
+        local_community_octaves[oct]--;
+        if (oct > 0) local_community_octaves[oct - 1]++;
+      }
+    if (n == 1) {
+        num_species_--;
+        if (s >= meta_community_size && !pinned_[s]) {
+            if (dynamic_meta_) {
+                auto it = dynamic_to_registry_.find(species_registry[s].id_);
+                if (it != dynamic_to_registry_.end() && it->second == s) dynamic_to_registry_.erase(it);
+              }
+            free_species_.push_back(s);
+          }
+      }
   }
 
-  species get_species_from_meta_community() {
-    double p =  rndgen_.uniform() * cdf_.back(); //rndgen_.random_number(cdf_.back());
-    size_t index = std::distance(cdf_.cbegin(), std::lower_bound(cdf_.cbegin(), cdf_.cend(), p));
-    return meta_community[index];
+  void set_cell(size_t pos, species_index s) {
+    auto old = world[pos];
+    if (old == s) return;
+    world[pos] = s;
+    add_individual(s);
+    remove_individual(old);
   }
 
   size_t convert_to_pos(size_t x, size_t y) {
@@ -144,110 +338,102 @@ public:
 
   size_t get_coordinate(size_t source_x,
                         size_t source_y) {
-
-    static const float Pi = 3.14159265359f;
-    int distance = 1 + static_cast<int>(rndgen_.uniform() * dispersal_range);
-    float dir = rndgen_.uniform() * 2 * Pi;
-    double pY = static_cast<double>(sinf(dir) * distance);
-    double pX = static_cast<double>(cosf(dir) * distance);
-
-    int target_x = static_cast<int>(std::round(source_x + pX)); // round to get values >0.5 to be round up (or < -0.5 round down)
-    int target_y = static_cast<int>(std::round(source_y + pY));
-
-    int max_val = static_cast<int>(L);
-    if (target_x < 0)  target_x += max_val;
-    if (target_x >= max_val) target_x -= max_val;
-    if (target_y < 0)  target_y += max_val;
-    if (target_y >= max_val) target_y -= max_val;
-
-    if (target_x == source_x && target_y == source_y) {
-        return get_coordinate(source_x, source_y);
-    }
-
-    return convert_to_pos(target_x, target_y);
+    return dispersal_(source_x, source_y, rndgen_);
   }
 
 
 
-  species local_reproduction(size_t source_index) {
-    auto pos = get_coordinate(world[source_index].x_,
-                              world[source_index].y_);
+  species_index local_reproduction(size_t source_index) {
+    auto pos = get_coordinate(source_index / L,
+                              source_index % L);
 
-    return world[pos].get_species();
+    return world[pos];
   }
 
 
   void update() {
     size_t pos_to_die = rndgen_.random_pos();
 
-    if (rndgen_.bernouilli(prob_same)) {
+    if (rndgen_.below_threshold(prob_same_threshold_)) {
         // reproduce locally
-        world[pos_to_die].set_species( local_reproduction( pos_to_die ) );
+        set_cell(pos_to_die, local_reproduction( pos_to_die ));
       } else {
-        if (rndgen_.bernouilli(rel_prob_spec)) {
+        if (rndgen_.below_threshold(rel_prob_spec_threshold_)) {
             // speciation
-            world[pos_to_die].set_species( species(1, rndgen_));
+            set_cell(pos_to_die, new_species());
           } else {
             // migration
-            world[pos_to_die].set_species( get_species_from_meta_community());
+            set_cell(pos_to_die, get_species_from_meta_community());
           }
       }
     t++;
   }
 
   std::array<size_t, 3> get_color(size_t pos) const {
-    return world[pos].get_species().get_color();
+    return species_registry[world[pos]].get_color();
   }
 
+  // abundances and octaves are maintained by update(), so this only
+  // fills the rank abundance curve from the counts of counts,
+  // O(max_abundance + S).
   size_t update_stats() {
-    histogram_local_comm.clear();
-    for (const auto& i : world) {
-        ++histogram_local_comm[i.get_species_id()];
-      }
-
-    local_community_octaves.clear();
-    local_community_octaves = std::vector<int>(1 + static_cast<int>(log2(world.size())), 0);
-    for(const auto& i : histogram_local_comm) {
-        auto oct = octave_sort(i.second);
-        local_community_octaves[oct]++;
-      }
-
     update_rank_abund_curve();
 
-    return histogram_local_comm.size();
+    return num_species_;
   }
 
+  // counts of counts are kept by update(), so this needs no sort
   void update_rank_abund_curve() {
-    rank_abund_curve = std::vector<double>(histogram_local_comm.size());
-    int cnt = 0;
-    double max = -1;
-    for (const auto& i : histogram_local_comm) {
-        rank_abund_curve[cnt] = i.second;
-        if (i.second > max) max = i.second;
-        cnt++;
-      }
-    std::sort(rank_abund_curve.begin(), rank_abund_curve.end(), std::greater<double>());
-    double mult = 100.0 / max;
+    ranks_.fill(rank_abund_curve);
+    if (rank_abund_curve.empty()) return;
+    double mult = 100.0 / ranks_.max_abundance();
     for(auto& i : rank_abund_curve) {
         i *= mult;
       }
   }
 
-  size_t octave_sort(long ab_in) { //adapted from James
-    size_t result;
-    if(ab_in <= 0) {
-        result = 0;
-      } else {
-        long min = 1;
-        long max = 2;
-        result = 0;
-        while(!((ab_in < max)&&(ab_in >= min))) {
-            min = min*2;
-            max = max*2;
-            result ++;
-          }
+  // abundance of the species at rank r, 0 being the most abundant;
+  // requires r < num_species()
+  size_t abundance_at_rank(size_t r) const {
+    return ranks_.at_rank(r);
+  }
+
+  // abundances of the (at most) k most abundant species
+  std::vector<size_t> top_ranks(size_t k) const {
+    std::vector<size_t> out(std::min(k, num_species_));
+    for (size_t r = 0; r < out.size(); ++r) out[r] = abundance_at_rank(r);
+    return out;
+  }
+
+  // (rank, abundance) at about num_points ranks spaced evenly on a log
+  // scale from the first to the last rank; ranks start at 1
+  std::vector< std::pair<size_t, size_t> > log_rank_sample(size_t num_points) const {
+    std::vector< std::pair<size_t, size_t> > out;
+    if (num_species_ == 0 || num_points == 0) return out;
+    const double step = num_points > 1 ? std::log(static_cast<double>(num_species_)) / (num_points - 1) : 0.0;
+    for (size_t i = 0; i < num_points; ++i) {
+        auto rank = static_cast<size_t>(std::round(std::exp(step * i)));
+        rank = std::min(std::max<size_t>(rank, 1), num_species_);
+        if (!out.empty() && out.back().first == rank) continue;
+        out.push_back({rank, abundance_at_rank(rank - 1)});
       }
+    return out;
+  }
+
+  size_t octave_sort(long ab_in) { //adapted from James
+    if(ab_in <= 0) return 0;
+    return octave_of(static_cast<size_t>(ab_in));
+  }
+
+  // floor(log2(n)) for n > 0, by a bit scan
+  static size_t octave_of(size_t n) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - static_cast<size_t>(__builtin_clzll(static_cast<unsigned long long>(n)));
+#else
+    size_t result = 0;
+    while (n >>= 1) result++;
     return result;
+#endif
   }
 
   void update_octave_meta_comm() {
@@ -258,65 +444,118 @@ public:
 
     // should not go beyond 2^100 normally...
     meta_community_octaves = std::vector<int>(100, 0);
-    for(const auto& i : meta_community) {
-        auto oct = octave_sort(i.count_);
+    for(size_t i = 0; i < meta_community_size; ++i) {
+        auto oct = octave_sort(species_registry[i].count_);
         meta_community_octaves[oct]++;
       }
+    // a lazy metacommunity only knows the species drawn so far, and has
+    // no counts at all when it is infinite
+    if (lazy_meta_ && !lazy_meta_->is_infinite()) {
+        for (size_t k = 0; k < lazy_meta_->size(); ++k) {
+            meta_community_octaves[octave_sort(lazy_meta_->abundance(k))]++;
+          }
+      }
+    if (dynamic_meta_) {
+        for (auto i : dynamic_meta_->abundances()) {
+            meta_community_octaves[octave_sort(i)]++;
+          }
+      }
 
     // remove trailing zeros:
-    while(meta_community_octaves.back() == 0) {
+    while(!meta_community_octaves.empty() && meta_community_octaves.back() == 0) {
         meta_community_octaves.pop_back();
       }
   }
 
   std::vector< int > get_meta_octaves() {
+    if (!is_meta_sampler_shared()) update_octave_meta_comm();
     return meta_community_octaves;
   }
 
-  std::vector< int > get_local_octaves() {
-    if (local_community_octaves.empty()) {
-        update_stats();
-      }
+  const std::vector< int >& get_local_octaves() const {
     return local_community_octaves;
   }
 
-  int num_species() {
-    return histogram_local_comm.size();
+  size_t get_seed() const noexcept {
+    return seed_;
+  }
+
+  size_t get_replicate() const noexcept {
+    return replicate_;
+  }
+
+  int num_species() const {
+    return static_cast<int>(num_species_);
+  }
+
+  size_t get_abundance(species_index s) const {
+    return abundance_[s];
   }
 
+  // species-area curve of the squares [0, k) x [0, k), k = 1..L. A
+  // species is first found in the square of side max(x, y) + 1 of the
+  // nearest of its cells, so one pass over the world gives each species'
+  // smallest square, and a prefix sum over those sides gives the curve.
   void update_species_area(std::vector< double >& area,
                            std::vector< double >& num_species) {
 
     area.clear();
     num_species.clear();
-    std::vector< species > found_species;
-
-    for(size_t x = 0; x < L; ++x) {
-        for(size_t y = 0; y <= x; ++y) {
-            auto pos = convert_to_pos(x, y );
-            bool match = false;
-            auto local = world[pos].get_species();
-            for (const auto& i : found_species) {
-              if(i == local) {
-                    match = true;
-                    break;
-              }
-            }
 
-            if(!match) {
-                found_species.push_back(local);
-            }
+    // 0: not seen yet
+    auto& first_side = sar_first_side_;
+    first_side.assign(species_registry.size(), 0);
+    std::vector< size_t > new_at_side(L + 1, 0);
+
+    for (size_t x = 0; x < L; ++x) {
+        const species_index* row = world.data() + x * L;
+        for (size_t y = 0; y < L; ++y) {
+            const auto side = static_cast<uint32_t>(std::max(x, y) + 1);
+            auto& s = first_side[row[y]];
+            if (s == 0 || side < s) s = side;
           }
-        if(x > 0) {
-            area.push_back( static_cast<double>(x * x) );
-            num_species.push_back(static_cast<double>(found_species.size()));
-        }
+      }
+    for (auto s : first_side) {
+        if (s > 0) new_at_side[s]++;
+      }
+
+    size_t found = 0;
+    for (size_t k = 1; k <= L; ++k) {
+        found += new_at_side[k];
+        area.push_back(static_cast<double>(k * k));
+        num_species.push_back(static_cast<double>(found));
       }
     return;
   }
-};
 
+  // mean richness and per-species occupancy of blocks of side 1, 2, 4, ...
+  // tiling the world, see block_aggregation.h
+  std::vector< grain_stats > multi_grain_stats(size_t num_threads = 1) const {
+    return block_aggregation(world, L, species_registry.size(), num_threads).run();
+  }
+
+  // approximate mean richness of blocks of side base_side, 2 base_side,
+  // ... from HyperLogLog sketches with 2^precision registers; base_side 0
+  // picks it from the memory budget, see hll_sketch.h
+  std::vector< approx_grain > approx_multi_grain_richness(size_t base_side = 0,
+                                                          size_t precision = 10,
+                                                          size_t num_threads = 1) const {
+    return hll_block_aggregation(world, L, base_side, precision, num_threads).run();
+  }
+
+  // probability that two individuals at distance r are conspecific, exact
+  // for the num_fft_species most abundant species and sampled for the
+  // others, see pair_correlation.h
+  pair_correlation_result conspecific_correlation(size_t num_fft_species = 16,
+                                                  size_t samples_per_bin = 10000,
+                                                  size_t num_threads = 1) const {
+    return pair_correlation(world, L, abundance_, num_fft_species,
+                            samples_per_bin, num_threads).run(seed_, replicate_);
+  }
+};
 
+// the GUI and the batch runner default to the original polar kernel
+using simulation = simulation_t<polar_kernel>;
 
 
 #endif /* simulation_h */
@@ -0,0 +1,134 @@
+//
+//  thread_pool.h
+//  neutralizer_backbone
+//
+//  Work-stealing thread pool: every worker has its own task deque, takes
+//  work from the back of it and steals from the front of the others when
+//  it runs dry.
+//
+
+#ifndef thread_pool_h
+#define thread_pool_h
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <algorithm>
+
+class work_stealing_pool {
+public:
+  explicit work_stealing_pool(size_t num_threads) {
+    if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < num_threads; ++i) {
+      queues_.push_back(std::make_unique<task_queue>());
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+      workers_.emplace_back([this, i] { worker_loop(i); });
+    }
+  }
+
+  ~work_stealing_pool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      stop_ = true;
+    }
+    sleep_cv_.notify_all();
+    for (auto& i : workers_) i.join();
+  }
+
+  work_stealing_pool(const work_stealing_pool&) = delete;
+  work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+  size_t num_threads() const noexcept {
+    return workers_.size();
+  }
+
+  // tasks are dealt round-robin; idle workers steal the rest
+  void submit(std::function<void()> task) {
+    pending_++;
+    size_t q = next_queue_++ % queues_.size();
+    {
+      std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+      queues_[q]->tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      queued_++;
+    }
+    sleep_cv_.notify_one();
+  }
+
+  // blocks until every submitted task has finished
+  void wait_idle() {
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_cv_.wait(lock, [this] { return pending_ == 0; });
+  }
+
+private:
+  struct task_queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<task_queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> next_queue_{0};
+  std::atomic<size_t> pending_{0};
+
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  size_t queued_ = 0;
+  bool stop_ = false;
+
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cv_;
+
+  bool pop_own(size_t id, std::function<void()>& task) {
+    auto& q = *queues_[id];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) return false;
+    task = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    return true;
+  }
+
+  bool steal(size_t id, std::function<void()>& task) {
+    for (size_t k = 1; k < queues_.size(); ++k) {
+      auto& q = *queues_[(id + k) % queues_.size()];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (q.tasks.empty()) continue;
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+      return true;
+    }
+    return false;
+  }
+
+  void worker_loop(size_t id) {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleep_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+        if (queued_ == 0) return; // stop_ and nothing left
+        queued_--;
+      }
+      // a task is reserved for us, it sits in one of the deques
+      std::function<void()> task;
+      while (!pop_own(id, task) && !steal(id, task)) {
+        std::this_thread::yield();
+      }
+      task();
+      if (--pending_ == 0) {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_cv_.notify_all();
+      }
+    }
+  }
+};
+
+#endif /* thread_pool_h */
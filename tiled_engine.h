@@ -0,0 +1,282 @@
+//
+//  tiled_engine.h
+//  neutralizer_backbone
+//
+//  Multithreaded update of a simulation_t by domain decomposition.
+//
+
+#ifndef tiled_engine_h
+#define tiled_engine_h
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include "cell.h"
+#include "rand_t.h"
+
+template <typename DISPERSAL> class simulation_t;
+
+// reusable barrier for a fixed number of threads (std::barrier is C++20)
+class thread_barrier {
+public:
+  explicit thread_barrier(size_t num_threads) : num_threads_(num_threads) {}
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto gen = generation_;
+    if (++waiting_ == num_threads_) {
+      waiting_ = 0;
+      generation_++;
+      cv_.notify_all();
+    } else {
+      cv_.wait(lock, [&] { return gen != generation_; });
+    }
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t num_threads_;
+  size_t waiting_ = 0;
+  size_t generation_ = 0;
+};
+
+struct tiled_run_stats {
+  size_t events = 0;
+  double seconds = 0.0;
+  size_t num_tiles = 0;
+  std::vector<size_t> events_per_thread;
+
+  double events_per_second() const {
+    return seconds > 0.0 ? events / seconds : 0.0;
+  }
+
+  double events_per_second_per_thread() const {
+    return events_per_thread.empty() ? 0.0 : events_per_second() / events_per_thread.size();
+  }
+};
+
+// The torus is cut into n x n tiles (n even), each at least as wide as the
+// reach of the dispersal kernel and as min_tile_width; the layout depends
+// on L and the kernel only, never on the number of threads. Tiles are
+// coloured by (tx % 2, ty % 2): two tiles of the same colour are separated
+// by a full tile, so the cells one tile writes and the halo it reads never
+// overlap with another tile of that colour. Every phase, all tiles of one colour run their share of
+// Moran events concurrently; the four colours alternate.
+//
+// Each tile runs on its own stream (seed, replicate, tile, phase), writes
+// its changes into a log, and logs are merged in tile order afterwards, so
+// the outcome does not depend on the number of threads. New species get a
+// placeholder index during the phase and a registry entry during the merge.
+// Lazy and dynamic metacommunities cannot be sampled concurrently, so in
+// those modes migrants are placeholders as well and are drawn during the
+// merge.
+//
+// The Moran process is recovered as the phase length goes to zero: within
+// a phase a tile does a fixed number of events instead of competing with
+// all other cells. events_per_cell sets that length (events per cell per
+// phase); the default of 0.05 keeps it well below a generation.
+template <typename DISPERSAL>
+class tiled_engine {
+public:
+  tiled_engine(simulation_t<DISPERSAL>& sim,
+               size_t num_threads,
+               double events_per_cell = 0.05,
+               size_t min_tile_width = 32) :
+    sim_(sim),
+    num_threads_(std::max<size_t>(1, num_threads)),
+    events_per_cell_(events_per_cell) {
+    make_tiles(min_tile_width);
+  }
+
+  // false if the kernel reaches too far for at least 4 x 4 tiles; run()
+  // then falls back to serial updates
+  bool is_parallel() const noexcept {
+    return tiles_per_side_ >= 4;
+  }
+
+  size_t num_tiles() const noexcept {
+    return tiles_.size();
+  }
+
+  // runs at least num_events events (whole phases)
+  tiled_run_stats run(size_t num_events) {
+    tiled_run_stats stats;
+    stats.num_tiles = tiles_.size();
+    stats.events_per_thread.assign(num_threads_, 0);
+    auto start = std::chrono::steady_clock::now();
+    size_t t_start = sim_.t;
+
+    if (!is_parallel()) {
+      for (size_t i = 0; i < num_events; ++i) sim_.update();
+      stats.events_per_thread[0] = num_events;
+    } else {
+      thread_barrier barrier(num_threads_);
+      std::atomic<size_t> next_tile{0};
+      bool done = false;
+      size_t color = 0;
+
+      auto worker = [&](size_t thread_id) {
+        while (true) {
+          barrier.wait();             // phase set up by thread 0
+          if (done) return;
+          const auto& active = tiles_by_color_[color];
+          for (size_t i = next_tile++; i < active.size(); i = next_tile++) {
+            stats.events_per_thread[thread_id] += run_tile(tiles_[active[i]]);
+          }
+          barrier.wait();             // phase finished, thread 0 merges
+        }
+      };
+
+      std::vector<std::thread> threads;
+      for (size_t i = 1; i < num_threads_; ++i) {
+        threads.emplace_back(worker, i);
+      }
+
+      while (true) {
+        done = sim_.t - t_start >= num_events;
+        next_tile = 0;
+        barrier.wait();
+        if (done) break;
+        const auto& active = tiles_by_color_[color];
+        for (size_t i = next_tile++; i < active.size(); i = next_tile++) {
+          stats.events_per_thread[0] += run_tile(tiles_[active[i]]);
+        }
+        barrier.wait();
+        for (auto i : active) merge_tile(tiles_[i]);
+        sim_.parallel_step_++;
+        color = (color + 1) % 4;
+      }
+      for (auto& i : threads) i.join();
+    }
+
+    stats.events = sim_.t - t_start;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+  }
+
+private:
+  // placeholder indices for species that arise during a phase
+  static constexpr species_index pending_bit = 0x80000000u;
+  static constexpr size_t max_tiles_per_side = 64;
+
+  struct log_entry {
+    uint32_t pos;
+    species_index old_species;
+    species_index new_species;
+  };
+
+  struct pending_species {
+    species_index index;  // registry index | pending_bit once resolved, 0 before
+    bool migrant;
+  };
+
+  struct tile {
+    size_t id;
+    size_t x0, x1, y0, y1;
+    size_t events_per_phase;
+    std::vector<log_entry> log;
+    std::vector<pending_species> pending; // placeholder -> registry index
+  };
+
+  simulation_t<DISPERSAL>& sim_;
+  size_t num_threads_;
+  double events_per_cell_;
+  size_t tiles_per_side_ = 0;
+  std::vector<tile> tiles_;
+  std::vector<size_t> tiles_by_color_[4];
+
+  void make_tiles(size_t min_tile_width) {
+    const size_t L = sim_.L;
+    const size_t reach = std::max<size_t>(1, sim_.dispersal_.reach());
+
+    // as many tiles as fit, but none narrower than the reach of the kernel
+    tiles_per_side_ = std::min(L / std::max(reach, min_tile_width), max_tiles_per_side);
+    if (L / reach >= 4) tiles_per_side_ = std::max<size_t>(tiles_per_side_, 4);
+    if (tiles_per_side_ % 2) tiles_per_side_--;
+    if (tiles_per_side_ < 4) {
+      tiles_per_side_ = 0;
+      return;
+    }
+
+    const size_t n = tiles_per_side_;
+    for (size_t tx = 0; tx < n; ++tx) {
+      for (size_t ty = 0; ty < n; ++ty) {
+        tile t;
+        t.id = tx * n + ty;
+        t.x0 = tx * L / n;
+        t.x1 = (tx + 1) * L / n;
+        t.y0 = ty * L / n;
+        t.y1 = (ty + 1) * L / n;
+        double cells = static_cast<double>((t.x1 - t.x0) * (t.y1 - t.y0));
+        t.events_per_phase = std::max<size_t>(1, static_cast<size_t>(std::round(cells * events_per_cell_)));
+        tiles_by_color_[(tx % 2) + 2 * (ty % 2)].push_back(t.id);
+        tiles_.push_back(std::move(t));
+      }
+    }
+  }
+
+  size_t run_tile(tile& t) {
+    auto& world = sim_.world;
+    rnd_t rndgen(sim_.seed_, sim_.replicate_, t.id + 1, sim_.parallel_step_);
+    const uint32_t w = static_cast<uint32_t>(t.x1 - t.x0);
+    const uint32_t h = static_cast<uint32_t>(t.y1 - t.y0);
+    const size_t L = sim_.L;
+    t.log.clear();
+    t.pending.clear();
+
+    for (size_t i = 0; i < t.events_per_phase; ++i) {
+      size_t x = t.x0 + rndgen.bounded32(w);
+      size_t y = t.y0 + rndgen.bounded32(h);
+      size_t pos = x * L + y;
+
+      species_index new_species;
+      if (rndgen.below_threshold(sim_.prob_same_threshold_)) {
+        new_species = world[sim_.dispersal_(x, y, rndgen)];
+      } else if (rndgen.below_threshold(sim_.rel_prob_spec_threshold_)) {
+        new_species = pending_bit | static_cast<species_index>(t.pending.size());
+        t.pending.push_back(pending_species{0, false});
+      } else if (!sim_.is_meta_sampler_shared()) {
+        new_species = pending_bit | static_cast<species_index>(t.pending.size());
+        t.pending.push_back(pending_species{0, true});
+      } else {
+        new_species = static_cast<species_index>(sim_.meta_sampler_.sample(rndgen));
+      }
+
+      if (world[pos] != new_species) {
+        t.log.push_back(log_entry{static_cast<uint32_t>(pos), world[pos], new_species});
+        world[pos] = new_species;
+      }
+    }
+    return t.events_per_phase;
+  }
+
+  species_index resolve(tile& t, species_index s) {
+    if (!(s & pending_bit)) return s;
+    auto& slot = t.pending[s & ~pending_bit];
+    if (slot.index == 0) { // keep 0 free as "unset"
+      auto index = slot.migrant ? sim_.get_species_from_meta_community() : sim_.new_species();
+      slot.index = index | pending_bit;
+    }
+    return slot.index & ~pending_bit;
+  }
+
+  void merge_tile(tile& t) {
+    auto& world = sim_.world;
+    for (const auto& e : t.log) {
+      auto old_species = resolve(t, e.old_species);
+      auto new_species = resolve(t, e.new_species);
+      if (world[e.pos] & pending_bit) world[e.pos] = resolve(t, world[e.pos]);
+      sim_.add_individual(new_species);
+      sim_.remove_individual(old_species);
+    }
+    sim_.t += t.events_per_phase;
+  }
+};
+
+#endif /* tiled_engine_h */
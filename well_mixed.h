@@ -0,0 +1,409 @@
+//
+//  well_mixed.h
+//  neutralizer_backbone
+//
+//  Spatially implicit local community (Hubbell 2001), for dispersal that
+//  spans the whole landscape: only abundances are kept, no grid.
+//
+
+#ifndef well_mixed_h
+#define well_mixed_h
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include "cell.h"
+#include "rand_t.h"
+#include "alias_table.h"
+#include "fenwick_tree.h"
+#include "rank_abundance.h"
+#include "ewens.h"
+#include "lazy_metacommunity.h"
+#include "dynamic_metacommunity.h"
+#include "meta_cache.h"
+#include "simulation.h"
+
+// When the dispersal range is at least L, a parent is (close to) any
+// individual of the landscape, and the positions in world carry no
+// information. This model has the interface of simulation_t that the GUI
+// and the batch runner use, but keeps J = L * L individuals as one count
+// per local species, in a Fenwick tree: a Moran event picks the dying
+// individual and the parent among the J - 1 others by a prefix sum search,
+// O(log S), and memory is O(S) whatever J is. Speciation and immigration
+// are as in simulation_t, with the same metacommunity in every mode (the
+// fixed one is the same partition, and shares meta_cache).
+//
+// Slots of extinct species are recycled. A metacommunity species keeps
+// one slot while it is present, found by its key (registry index, lazy
+// index or dynamic id). There is no space, so get_color() shows the
+// individuals in slot order, and the species-area curve is the expected
+// richness of a random sample of k * k individuals (rarefaction), at up
+// to max_area_points values of k.
+//
+// As in simulation_t, counts of counts (see rank_abundance.h) give the
+// rank abundance curve without a sort. They take 4 bytes per abundance
+// value up to the largest abundance, which can be J, so above
+// max_ranked_individuals they are not kept and the curve is sorted from
+// the counts instead, O(S log S).
+class well_mixed_simulation {
+public:
+  static constexpr size_t max_area_points = 128;
+  static constexpr size_t max_ranked_individuals = size_t{1} << 24;
+
+  size_t t;
+  size_t L;
+  std::vector<double> rank_abund_curve;
+
+  well_mixed_simulation(size_t one_side,
+                        double sp,
+                        double mgr,
+                        size_t meta_comm_size,
+                        double /* disp_range */,
+                        double theta,
+                        bool init_mono_dom,
+                        size_t seed,
+                        size_t replicate = 0,
+                        metacommunity_mode meta_mode = metacommunity_mode::fixed,
+                        double meta_rate = 1.0,
+                        bool meta_background = false) :
+    t(0),
+    L(one_side),
+    J_(one_side * one_side),
+    seed_(seed),
+    replicate_(replicate),
+    prob_same_threshold_(rnd_t::bernouilli_threshold(1.0 - sp - mgr)),
+    rel_prob_spec_threshold_(rnd_t::bernouilli_threshold(sp / (sp + mgr))),
+    rndgen_(seed, replicate, 0, 0),
+    ranked_(J_ <= max_ranked_individuals) {
+    if (meta_mode == metacommunity_mode::lazy) {
+        lazy_meta_ = std::make_unique<lazy_metacommunity>(meta_comm_size, theta,
+                                                          rnd_t(seed_, 0, 0, 1));
+      } else if (meta_mode == metacommunity_mode::dynamic) {
+        dynamic_meta_ = std::make_unique<dynamic_metacommunity>(meta_comm_size, theta, meta_rate,
+                                                                rnd_t(seed_, replicate_, 0, 2),
+                                                                meta_background);
+      } else {
+        create_meta_community(meta_comm_size, theta);
+      }
+
+    local_community_octaves_.assign(1 + simulation::octave_of(std::max<size_t>(J_, 1)), 0);
+
+    if (init_mono_dom) {
+        add_individuals(species_from_meta_community(), J_);
+      } else if (!lazy_meta_ && !dynamic_meta_) {
+        // the multinomial of J draws from the metacommunity, one binomial
+        // per metacommunity species
+        size_t remaining = J_;
+        size_t mass = 0;
+        for (const auto& i : meta_registry_) mass += i.count_;
+        for (size_t i = 0; i < meta_registry_.size() && remaining > 0; ++i) {
+            const size_t count = meta_registry_[i].count_;
+            size_t n = remaining;
+            if (count < mass) {
+                std::binomial_distribution<size_t> binom(remaining, 1.0 * count / mass);
+                n = binom(rndgen_.rndgen);
+              }
+            mass -= count;
+            remaining -= n;
+            if (n > 0) add_individuals(slot_of(i, [&] { return meta_registry_[i]; }), n);
+          }
+      } else {
+        for (size_t i = 0; i < J_; ++i) add_individuals(species_from_meta_community(), 1);
+      }
+    if (ranked_) ranks_.assign(abundance_);
+  }
+
+  void update() {
+    // the dying individual, uniform over all J
+    const size_t dead = fenwick_.find(rndgen_.random_number(J_));
+    if (rndgen_.below_threshold(prob_same_threshold_)) {
+        if (J_ > 1) {
+            // the parent, uniform over the J - 1 others
+            remove_individual(dead);
+            add_individual(fenwick_.find(rndgen_.random_number(J_ - 1)));
+          }
+      } else if (rndgen_.below_threshold(rel_prob_spec_threshold_)) {
+        remove_individual(dead);
+        add_individual(new_slot(species(1, rndgen_), no_key));
+      } else {
+        remove_individual(dead);
+        add_individual(species_from_meta_community());
+      }
+    t++;
+  }
+
+  // the rank abundance curve from the counts of counts,
+  // O(max_abundance + S), see simulation_t::update_rank_abund_curve
+  size_t update_stats() {
+    if (ranked_) {
+        ranks_.fill(rank_abund_curve);
+      } else {
+        rank_abund_curve.clear();
+        for (auto n : sorted_abundances()) rank_abund_curve.push_back(static_cast<double>(n));
+      }
+    if (!rank_abund_curve.empty()) {
+        const double mult = 100.0 / rank_abund_curve.front();
+        for (auto& i : rank_abund_curve) i *= mult;
+      }
+    return num_species_;
+  }
+
+  // abundance of the species at rank r, 0 being the most abundant;
+  // requires r < num_species()
+  size_t abundance_at_rank(size_t r) const {
+    if (ranked_) return ranks_.at_rank(r);
+    auto sorted = present_abundances();
+    std::nth_element(sorted.begin(), sorted.begin() + r, sorted.end(), std::greater<size_t>());
+    return sorted[r];
+  }
+
+  // abundances of the (at most) k most abundant species
+  std::vector<size_t> top_ranks(size_t k) const {
+    std::vector<size_t> out(std::min(k, num_species_));
+    if (ranked_) {
+        for (size_t r = 0; r < out.size(); ++r) out[r] = ranks_.at_rank(r);
+      } else {
+        auto sorted = sorted_abundances();
+        std::copy(sorted.begin(), sorted.begin() + out.size(), out.begin());
+      }
+    return out;
+  }
+
+  // (rank, abundance) at about num_points ranks spaced evenly on a log
+  // scale from the first to the last rank; ranks start at 1, as
+  // simulation_t::log_rank_sample
+  std::vector< std::pair<size_t, size_t> > log_rank_sample(size_t num_points) const {
+    std::vector< std::pair<size_t, size_t> > out;
+    if (num_species_ == 0 || num_points == 0) return out;
+    std::vector< size_t > sorted;
+    if (!ranked_) sorted = sorted_abundances();
+    const double step = num_points > 1 ? std::log(static_cast<double>(num_species_)) / (num_points - 1) : 0.0;
+    for (size_t i = 0; i < num_points; ++i) {
+        auto rank = static_cast<size_t>(std::round(std::exp(step * i)));
+        rank = std::min(std::max<size_t>(rank, 1), num_species_);
+        if (!out.empty() && out.back().first == rank) continue;
+        out.push_back({rank, ranked_ ? ranks_.at_rank(rank - 1) : sorted[rank - 1]});
+      }
+    return out;
+  }
+
+  // individual pos in slot order
+  std::array<size_t, 3> get_color(size_t pos) const {
+    return slots_[fenwick_.find(pos % J_)].get_color();
+  }
+
+  std::vector< int > get_meta_octaves() const {
+    std::vector< int > octaves(100, 0);
+    auto add = [&](size_t count) { if (count > 0) octaves[simulation::octave_of(count)]++; };
+    for (const auto& i : meta_registry_) add(i.count_);
+    if (lazy_meta_ && !lazy_meta_->is_infinite()) {
+        for (size_t k = 0; k < lazy_meta_->size(); ++k) add(lazy_meta_->abundance(k));
+      }
+    if (dynamic_meta_) {
+        for (auto i : dynamic_meta_->abundances()) add(i);
+      }
+    while (!octaves.empty() && octaves.back() == 0) octaves.pop_back();
+    return octaves;
+  }
+
+  const std::vector< int >& get_local_octaves() const {
+    return local_community_octaves_;
+  }
+
+  // expected number of species among n = k * k individuals drawn without
+  // replacement: sum over species of 1 - C(J - N_s, n) / C(J, n)
+  void update_species_area(std::vector< double >& area,
+                           std::vector< double >& num_species) const {
+    area.clear();
+    num_species.clear();
+    std::vector< size_t > sides;
+    const double step = std::pow(static_cast<double>(L), 1.0 / max_area_points);
+    for (double k = 1.0; k < L + 0.5; k = std::max(k * step, k + 1.0)) {
+        const auto side = static_cast<size_t>(std::round(k));
+        if (sides.empty() || sides.back() != side) sides.push_back(side);
+      }
+    if (L > 0 && sides.back() != L) sides.push_back(L);
+
+    const double log_all = std::lgamma(J_ + 1.0);
+    for (auto k : sides) {
+        const double n = static_cast<double>(k * k);
+        const double log_n = std::lgamma(J_ - n + 1.0) - log_all;
+        double expected = 0.0;
+        for (auto N_s : abundance_) {
+            if (N_s == 0) continue;
+            const double rest = static_cast<double>(J_ - N_s);
+            if (rest < n) {
+                expected += 1.0;
+                continue;
+              }
+            const double log_absent = std::lgamma(rest + 1.0) - std::lgamma(rest - n + 1.0) + log_n;
+            expected += -std::expm1(log_absent);
+          }
+        area.push_back(n);
+        num_species.push_back(expected);
+      }
+  }
+
+  size_t get_seed() const noexcept {
+    return seed_;
+  }
+
+  size_t get_replicate() const noexcept {
+    return replicate_;
+  }
+
+  int num_species() const {
+    return static_cast<int>(num_species_);
+  }
+
+  // number of slots in use or free: the memory of the model
+  size_t num_slots() const noexcept {
+    return slots_.size();
+  }
+
+private:
+  static constexpr uint64_t no_key = ~uint64_t(0);
+
+  const size_t J_;
+  const size_t seed_;
+  const size_t replicate_;
+  const uint64_t prob_same_threshold_;
+  const uint64_t rel_prob_spec_threshold_;
+  rnd_t rndgen_;
+
+  // per slot: the species (colour), its count and its metacommunity key
+  std::vector< species > slots_;
+  std::vector< size_t > abundance_;
+  std::vector< uint64_t > key_;
+  std::vector< size_t > free_slots_;
+  fenwick_tree fenwick_;
+  std::unordered_map< uint64_t, size_t > slot_of_key_;
+  size_t num_species_ = 0;
+  std::vector< int > local_community_octaves_;
+  // counts of counts, if J is at most max_ranked_individuals
+  const bool ranked_;
+  rank_abundance ranks_;
+
+  // fixed mode
+  std::vector< species > meta_registry_;
+  alias_table meta_sampler_;
+  // lazy and dynamic mode
+  std::unique_ptr< lazy_metacommunity > lazy_meta_;
+  std::unique_ptr< dynamic_metacommunity > dynamic_meta_;
+
+  // as simulation_t::create_meta_community, on the same stream and cache
+  void create_meta_community(size_t Jm, double theta) {
+    if (meta_cache::load(Jm, theta, seed_, meta_registry_, meta_sampler_)) return;
+    rnd_t meta_rndgen(seed_, 0, 0, 1);
+    auto abund = ewens_partition(Jm, theta, meta_rndgen);
+    meta_registry_.clear();
+    for (auto i : abund) meta_registry_.push_back(species(i, meta_rndgen));
+    meta_sampler_.build(abund);
+    meta_cache::store(Jm, theta, seed_, meta_registry_, meta_registry_.size(), meta_sampler_);
+  }
+
+  size_t species_from_meta_community() {
+    if (lazy_meta_) {
+        const size_t k = lazy_meta_->sample(rndgen_);
+        return slot_of(k, [&] {
+          rnd_t colour_rndgen(k);
+          return species(lazy_meta_->is_infinite() ? 0 : lazy_meta_->abundance(k), colour_rndgen);
+        });
+      }
+    if (dynamic_meta_) {
+        dynamic_meta_->set_clock(t);
+        const auto d = dynamic_meta_->sample(rndgen_);
+        return slot_of(d.id, [&] {
+          rnd_t colour_rndgen(d.id);
+          species s(d.count, colour_rndgen);
+          s.id_ = d.id;
+          return s;
+        });
+      }
+    const size_t i = meta_sampler_.sample(rndgen_);
+    return slot_of(i, [&] { return meta_registry_[i]; });
+  }
+
+  // the slot of metacommunity species key; make_species() builds the
+  // species (and its colour) only if it is not present yet, which is the
+  // rare case
+  template <typename F>
+  size_t slot_of(uint64_t key, F make_species) {
+    auto it = slot_of_key_.find(key);
+    if (it != slot_of_key_.end()) return it->second;
+    const size_t slot = new_slot(make_species(), key);
+    slot_of_key_[key] = slot;
+    return slot;
+  }
+
+  size_t new_slot(const species& s, uint64_t key) {
+    if (!free_slots_.empty()) {
+        const size_t slot = free_slots_.back();
+        free_slots_.pop_back();
+        slots_[slot] = s;
+        key_[slot] = key;
+        return slot;
+      }
+    slots_.push_back(s);
+    abundance_.push_back(0);
+    key_.push_back(key);
+    fenwick_.push_back(0);
+    return slots_.size() - 1;
+  }
+
+  void set_octave(size_t before, size_t after) {
+    if (before > 0) local_community_octaves_[simulation::octave_of(before)]--;
+    if (after > 0) local_community_octaves_[simulation::octave_of(after)]++;
+    if (before == 0 && after > 0) num_species_++;
+    if (before > 0 && after == 0) num_species_--;
+  }
+
+  std::vector< size_t > present_abundances() const {
+    std::vector< size_t > out;
+    out.reserve(num_species_);
+    for (auto n : abundance_) {
+        if (n > 0) out.push_back(n);
+      }
+    return out;
+  }
+
+  std::vector< size_t > sorted_abundances() const {
+    auto out = present_abundances();
+    std::sort(out.begin(), out.end(), std::greater<size_t>());
+    return out;
+  }
+
+  // n at once, while the community is built; the counts of counts are
+  // assigned afterwards
+  void add_individuals(size_t slot, size_t n) {
+    const size_t before = abundance_[slot];
+    abundance_[slot] += n;
+    fenwick_.add(slot, static_cast<long>(n));
+    set_octave(before, before + n);
+  }
+
+  void add_individual(size_t slot) {
+    const size_t before = abundance_[slot]++;
+    fenwick_.add(slot, 1);
+    set_octave(before, before + 1);
+    if (ranked_) ranks_.increment(before);
+  }
+
+  void remove_individual(size_t slot) {
+    const size_t before = abundance_[slot]--;
+    fenwick_.add(slot, -1);
+    set_octave(before, before - 1);
+    if (ranked_) ranks_.decrement(before);
+    if (before == 1) {
+        if (key_[slot] != no_key) slot_of_key_.erase(key_[slot]);
+        free_slots_.push_back(slot);
+      }
+  }
+};
+
+#endif /* well_mixed_h */
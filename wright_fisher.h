@@ -0,0 +1,231 @@
+//
+//  wright_fisher.h
+//  neutralizer_backbone
+//
+//  Generation-synchronous (Wright-Fisher) update of a simulation_t: every
+//  cell is replaced at once, from a copy of the previous generation.
+//
+
+#ifndef wright_fisher_h
+#define wright_fisher_h
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include "cell.h"
+#include "rand_t.h"
+#include "tiled_engine.h"
+
+template <typename DISPERSAL> class simulation_t;
+
+struct wright_fisher_run_stats {
+  size_t generations = 0;
+  size_t events = 0;          // L * L per generation
+  double seconds = 0.0;
+  size_t num_blocks = 0;
+
+  double events_per_second() const {
+    return seconds > 0.0 ? events / seconds : 0.0;
+  }
+};
+
+// In a generation every cell dies and is replaced, with the probabilities
+// of update(), by the offspring of a parent in the previous generation, by
+// a new species or by a migrant. The new generation only reads the old
+// one, so it is written into a second grid that is swapped with world
+// afterwards, and all cells can be filled in parallel. This is not the
+// Moran process of update(): there, a cell can be replaced twice in a
+// generation and offspring can reproduce before the generation is over.
+// Equilibria differ accordingly (a generation of update() carries about
+// twice the drift of one here), so runs in this mode should only be
+// compared with each other.
+//
+// The grid is cut into blocks of whole rows, about cells_per_block cells
+// each; the layout depends on L only. Each block runs on its own stream
+// (seed, replicate, block, stream_tag | step), so the outcome does not
+// depend on the number of threads. Within a row, the parents are drawn as
+// one batch by the kernel (see fill_row in dispersal.h) and then copied
+// from the old grid. Speciation and immigration are rare: the cells they
+// hit are found by geometric skips over the block, and overwrite the copy.
+// New species, and migrants of lazy and dynamic metacommunities, get a
+// registry entry after the parallel part, in block order. Abundances are
+// counted per thread while the blocks are filled, and handed to the
+// simulation in one go (see simulation_t::set_abundances).
+template <typename DISPERSAL>
+class wright_fisher_engine {
+public:
+  static constexpr size_t cells_per_block = size_t{1} << 14;
+
+  wright_fisher_engine(simulation_t<DISPERSAL>& sim, size_t num_threads) :
+    sim_(sim),
+    num_threads_(std::max<size_t>(1, num_threads)) {
+    const size_t L = sim_.L;
+    const size_t rows = std::max<size_t>(1, cells_per_block / std::max<size_t>(1, L));
+    for (size_t x0 = 0; x0 < L; x0 += rows) {
+      blocks_.push_back(block{x0, std::min(L, x0 + rows), {}});
+    }
+    counts_.resize(num_threads_);
+    parents_.resize(num_threads_);
+  }
+
+  size_t num_blocks() const noexcept {
+    return blocks_.size();
+  }
+
+  // runs whole generations, at least num_events events
+  wright_fisher_run_stats run(size_t num_events) {
+    wright_fisher_run_stats stats;
+    stats.num_blocks = blocks_.size();
+    auto start = std::chrono::steady_clock::now();
+    const size_t cells = sim_.L * sim_.L;
+    if (cells == 0) return stats;
+    const size_t generations = (num_events + cells - 1) / cells;
+
+    thread_barrier barrier(num_threads_);
+    std::atomic<size_t> next_block{0};
+    bool done = false;
+
+    auto fill_blocks = [&](size_t thread_id) {
+      for (size_t i = next_block++; i < blocks_.size(); i = next_block++) {
+        fill_block(blocks_[i], i, thread_id);
+      }
+    };
+
+    auto worker = [&](size_t thread_id) {
+      while (true) {
+        barrier.wait();             // generation set up by thread 0
+        if (done) return;
+        fill_blocks(thread_id);
+        barrier.wait();             // grid filled, thread 0 resolves
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads_; ++i) {
+      threads.emplace_back(worker, i);
+    }
+
+    for (size_t g = 0; ; ++g) {
+      done = g == generations;
+      if (!done) {
+        next_.resize(cells);
+        for (auto& c : counts_) c.assign(sim_.species_registry.size(), 0);
+        next_block = 0;
+      }
+      barrier.wait();
+      if (done) break;
+      fill_blocks(0);
+      barrier.wait();
+      finish_generation();
+    }
+    for (auto& i : threads) i.join();
+
+    stats.generations = generations;
+    stats.events = generations * cells;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+  }
+
+private:
+  // marks cells of the new grid that wait for a registry entry
+  static constexpr species_index pending = ~species_index(0);
+  // keeps block streams apart from the tile streams of tiled_engine
+  static constexpr size_t stream_tag = size_t{1} << 61;
+
+  struct pending_cell {
+    uint32_t pos;
+    bool migrant;
+  };
+
+  struct block {
+    size_t x0, x1;
+    std::vector<pending_cell> pending;
+  };
+
+  simulation_t<DISPERSAL>& sim_;
+  size_t num_threads_;
+  std::vector<block> blocks_;
+  std::vector<species_index> next_;
+  // per thread: individuals per registry entry in next_, and a row of
+  // parent positions
+  std::vector<std::vector<size_t>> counts_;
+  std::vector<std::vector<uint32_t>> parents_;
+
+  // failures before the first success, p in (0, 1]
+  static size_t geometric(double p, rnd_t& rndgen) {
+    if (p >= 1.0) return 0;
+    const double u = 1.0 - rndgen.uniform_double();   // (0, 1]
+    const double k = std::floor(std::log(u) / std::log1p(-p));
+    return k < 1e18 ? static_cast<size_t>(k) : static_cast<size_t>(1e18);
+  }
+
+  void fill_block(block& b, size_t block_id, size_t thread_id) {
+    const auto& world = sim_.world;
+    const size_t L = sim_.L;
+    rnd_t rndgen(sim_.seed_, sim_.replicate_, block_id + 1, stream_tag | sim_.parallel_step_);
+    auto& parents = parents_[thread_id];
+    parents.resize(L);
+
+    // every cell copies its parent
+    for (size_t x = b.x0; x < b.x1; ++x) {
+      sim_.dispersal_.fill_row(x, 0, L, parents.data(), rndgen);
+      species_index* row = next_.data() + x * L;
+      for (size_t y = 0; y < L; ++y) row[y] = world[parents[y]];
+    }
+
+    // and some of the copies are replaced by speciation or immigration
+    b.pending.clear();
+    const size_t begin = b.x0 * L;
+    const size_t end = b.x1 * L;
+    const double p_other = 1.0 - sim_.prob_same;
+    if (p_other > 0.0) {
+      for (size_t pos = begin + geometric(p_other, rndgen); pos < end;
+           pos += 1 + geometric(p_other, rndgen)) {
+        if (rndgen.below_threshold(sim_.rel_prob_spec_threshold_)) {
+          b.pending.push_back(pending_cell{static_cast<uint32_t>(pos), false});
+          next_[pos] = pending;
+        } else if (!sim_.is_meta_sampler_shared()) {
+          b.pending.push_back(pending_cell{static_cast<uint32_t>(pos), true});
+          next_[pos] = pending;
+        } else {
+          next_[pos] = static_cast<species_index>(sim_.meta_sampler_.sample(rndgen));
+        }
+      }
+    }
+
+    auto& counts = counts_[thread_id];
+    for (size_t pos = begin; pos < end; ++pos) {
+      if (next_[pos] != pending) counts[next_[pos]]++;
+    }
+  }
+
+  void finish_generation() {
+    // new species are taken from the free list of the old generation,
+    // whose entries are absent from the new one as well
+    std::vector<species_index> resolved;
+    for (auto& b : blocks_) {
+      for (const auto& c : b.pending) {
+        next_[c.pos] = c.migrant ? sim_.get_species_from_meta_community() : sim_.new_species();
+        resolved.push_back(next_[c.pos]);
+      }
+    }
+
+    auto& total = counts_[0];
+    total.resize(sim_.species_registry.size(), 0);
+    for (size_t i = 1; i < counts_.size(); ++i) {
+      for (size_t s = 0; s < counts_[i].size(); ++s) total[s] += counts_[i][s];
+    }
+    for (auto s : resolved) total[s]++;
+
+    sim_.world.swap(next_);
+    sim_.set_abundances(std::move(total));
+    sim_.t += sim_.L * sim_.L;
+    sim_.parallel_step_++;
+  }
+};
+
+#endif /* wright_fisher_h */